@@ -1,5 +1,5 @@
 from __future__ import annotations
-from typing import Type, Union, Optional, BinaryIO, Tuple
+from typing import Any, Dict, List, Sequence, Type, Union, Optional, BinaryIO, Tuple
 import os
 
 version: str = ...
@@ -40,6 +40,10 @@ Represents the version of the lunasvg library as a string in the format "major.m
 class Bitmap:
     """
     The `Bitmap` class provides an interface for rendering to memory buffers.
+
+    Pixels are stored as premultiplied ARGB32 in native byte order. Bitmaps implement the buffer
+    protocol as a (height, width, 4) array of bytes with row strides, so `numpy.asarray(bitmap)`
+    wraps the pixels without copying.
     """
 
     def __init__(self, width: int, height: int) -> None:
@@ -55,6 +59,8 @@ class Bitmap:
         """
         Creates a new `Bitmap` for the given writable memoryview.
 
+        The bitmap keeps the underlying buffer exported for as long as it is alive.
+
         :param data: A writable memoryview representing the bitmap data.
         :param width: The width of the bitmap in pixels.
         :param height: The height of the bitmap in pixels.
@@ -62,9 +68,41 @@ class Bitmap:
         :returns: A new `Bitmap` instance.
         """
 
+    @classmethod
+    def create_shared(cls, name: str, width: int, height: int) -> Bitmap:
+        """
+        Creates a new `Bitmap` backed by a named shared memory segment.
+
+        The segment stores the bitmap dimensions alongside the pixel data, so other processes
+        can map the same pixels with `attach_shared`. The segment persists until `unlink_shared` is called.
+
+        :param name: The name of the shared memory segment.
+        :param width: The width of the bitmap in pixels.
+        :param height: The height of the bitmap in pixels.
+        :returns: A new `Bitmap` instance.
+        :raises FileExistsError: If a segment with the given name already exists.
+        """
+
+    @classmethod
+    def attach_shared(cls, name: str) -> Bitmap:
+        """
+        Creates a new `Bitmap` for an existing shared memory segment created by `create_shared`.
+
+        :param name: The name of the shared memory segment.
+        :returns: A new `Bitmap` instance sharing its pixel data with the segment.
+        """
+
+    @classmethod
+    def unlink_shared(cls, name: str) -> None:
+        """
+        Removes the named shared memory segment. Bitmaps that are already attached remain valid.
+
+        :param name: The name of the shared memory segment.
+        """
+
     def data(self) -> memoryview:
         """
-        Returns a writable memoryview representing the bitmap data.
+        Returns a writable one-dimensional memoryview representing the bitmap data, including any row padding.
 
         :returns: A writable memoryview representing the bitmap data.
         """
@@ -111,6 +149,42 @@ class Bitmap:
         :param stream: A writable binary stream to output the PNG.
         """
 
+    def diff(self, other: Bitmap, threshold: int = 0, diff: bool = False) -> Tuple[int, int, float, float, Optional[Bitmap]]:
+        """
+        Compares the bitmap with another bitmap of the same size.
+
+        The comparison runs over the premultiplied ARGB data on all available cores. A pixel is
+        mismatched when any of its channels differs by more than `threshold`. PSNR is computed over
+        all channels. SSIM is computed over 8x8 blocks separately for the luma of the premultiplied colors
+        and for the alpha channel, and the two are averaged, so alpha differences lower it as well.
+
+        :param other: The bitmap to compare against.
+        :param threshold: The largest channel difference, from 0 to 255, at which pixels still match.
+        :param diff: If `True`, also returns a bitmap with mismatched pixels in red over a faded copy of this bitmap.
+        :returns: A tuple of the mismatched pixel count, the largest channel difference, the PSNR in decibels
+                  (`inf` for identical bitmaps), the SSIM, and the diff bitmap or `None`.
+        """
+
+    @property
+    def __array_interface__(self) -> Dict[str, Any]:
+        """
+        Describes the bitmap data as a (height, width, 4) array of unsigned bytes.
+        """
+
+    def __dlpack__(self, *, stream: Optional[Any] = None, max_version: Optional[Tuple[int, int]] = None, dl_device: Optional[Tuple[int, int]] = None, copy: Optional[bool] = None) -> Any:
+        """
+        Exports the bitmap data as a (height, width, 4) DLPack tensor of unsigned bytes.
+
+        :returns: A DLPack capsule sharing the bitmap data.
+        """
+
+    def __dlpack_device__(self) -> Tuple[int, int]:
+        """
+        Returns the DLPack device of the bitmap data.
+
+        :returns: A tuple of the device type and device id, always the CPU.
+        """
+
 class Matrix:
     """
     The `Matrix` class represents a 2D transformation matrix.
@@ -275,6 +349,37 @@ class Matrix:
         Resets this matrix to the identity matrix.
         """
 
+    def map_points(self, data: Any, out: Optional[Any] = None) -> Any:
+        """
+        Transforms an array of points stored as consecutive (x, y) float32 pairs.
+
+        The work runs with the GIL released using SIMD instructions where available.
+
+        :param data: A C-contiguous float32 buffer, such as an (N, 2) numpy array.
+        :param out: A writable float32 buffer at least as large as `data`, or `None` to transform `data` in place.
+        :returns: The buffer holding the transformed points.
+        """
+
+    def map_boxes(self, data: Any, out: Optional[Any] = None) -> Any:
+        """
+        Transforms an array of boxes stored as consecutive (x, y, w, h) float32 values,
+        replacing each with the bounding box of its transformed corners as `Box.transformed` does.
+
+        :param data: A C-contiguous float32 buffer, such as an (N, 4) numpy array.
+        :param out: A writable float32 buffer at least as large as `data`, or `None` to transform `data` in place.
+        :returns: The buffer holding the transformed boxes.
+        """
+
+    def map_matrices(self, data: Any, out: Optional[Any] = None) -> Any:
+        """
+        Composes an array of matrices stored as consecutive (a, b, c, d, e, f) float32 values with this matrix,
+        so that each resulting matrix applies the original one first and then this matrix.
+
+        :param data: A C-contiguous float32 buffer, such as an (N, 6) numpy array.
+        :param out: A writable float32 buffer at least as large as `data`, or `None` to compose `data` in place.
+        :returns: The buffer holding the composed matrices.
+        """
+
     a: float = ...
     """
     The horizontal scaling factor.
@@ -421,12 +526,19 @@ class Element:
         :param value: The value to assign to the attribute.
         """
 
-    def render(self, bitmap: Bitmap, matrix: Matrix = ...) -> None:
+    def render(self, bitmap: Bitmap, matrix: Matrix = ..., viewport: Optional[Box] = None, quality: float = 1.0) -> None:
         """
         Renders the element onto a bitmap using a transformation matrix.
 
+        When a viewport is given, the output is clipped to it and the rest of the bitmap is left
+        untouched. Only rasterization is limited to the viewport; every element is still traversed
+        and prepared, so that part of the cost does not shrink with the viewport.
+
         :param bitmap: The target bitmap for rendering.
         :param matrix: The root transformation matrix.
+        :param viewport: The region of the bitmap to render, in pixels.
+        :param quality: The resolution scale in (0, 1]. Values below 1 render at reduced resolution and
+            upsample the result, trading sharpness for speed in previews and thumbnails.
         """
 
     def render_to_bitmap(self, width: int = -1, height: int = -1, background_color: int = 0x00000000) -> Bitmap:
@@ -491,6 +603,14 @@ class Element:
 class Document:
     """
     The `Document` class represents an SVG document.
+
+    Every document keeps the source data it was loaded from alive for its whole lifetime, including
+    documents loaded with `Document(filename)`, so each document costs the size of its source in
+    addition to the parsed tree, even if it is never pickled, cloned or serialized.
+
+    Documents can be pickled. The pickled form is the source data the document was loaded from
+    together with the attribute changes made since. Only changes to the document element or to
+    elements with an `id` attribute can be replayed; other changes are not preserved.
     """
     def __init__(self, filename: Union[str, bytes, os.PathLike]) -> None:
         """
@@ -500,12 +620,55 @@ class Document:
         """
 
     @classmethod
-    def load_from_data(cls, data: str) -> Document:
+    def load_from_data(cls, data: Union[str, bytes, memoryview], stylesheet: Optional[str] = None, variables: Optional[Dict[str, str]] = None) -> Document:
+        """
+        Loads an SVG document from a string or a bytes-like object.
+
+        Writable bytes-like objects, including `bytearray` and the `buf` of a
+        `multiprocessing.shared_memory.SharedMemory`, are copied. Only read-only bytes-like objects
+        other than `bytes`, such as `memoryview(...).toreadonly()` or a read-only `mmap`, are referenced
+        rather than copied, so the underlying data must not be modified for the lifetime of the
+        document. To parse a shared segment without copying, pass a read-only view of it.
+
+        When a stylesheet or variables are given, the data is themed in a single pass before parsing:
+        each `var(--name)` or `var(--name, fallback)` in attribute values, `<style>` elements and the
+        stylesheet is replaced by the matching variable, escaped for the context it is inserted in.
+        Text content and comments are left unchanged. The stylesheet is inserted as a `<style>`
+        element at the end of the document element, so its rules take precedence over the document's
+        own style rules of equal specificity. The themed data becomes the source data of the document.
+
+        :param data: The string or bytes-like object containing the SVG data.
+        :param stylesheet: CSS rules to apply to the document.
+        :param variables: A mapping of variable names, with or without the leading `--`, to their values.
+        :returns: A `Document` instance containing the parsed SVG data.
         """
-        Loads an SVG document from a string.
 
-        :param data: The string containing the SVG data.
-        :returns: A `Document` instance containing the parsed SVG data.
+    def clone(self) -> Document:
+        """
+        Creates a copy of the document by parsing the retained source data again.
+
+        The attribute changes made to this document are then replayed on the copy. The cost of a
+        clone is that of a full parse, proportional to the size of the document; only the
+        serialization step of a `to_svg` and reload round trip is saved.
+
+        Only changes to the document element or to elements with an `id` attribute can be replayed.
+        If other elements were changed, the copy does not contain those changes and a `RuntimeWarning`
+        is issued. Changes made to the copy do not affect this document, and vice versa.
+
+        :returns: A new `Document` instance.
+        """
+
+    def to_svg(self, stream: Optional[BinaryIO] = None, minify: bool = False) -> Optional[bytes]:
+        """
+        Serializes the document, including attribute changes, back to SVG.
+
+        The source data the document was loaded from is rewritten with the changes made through
+        `Element.set_attribute` applied. Changes to elements without an `id` attribute, other than
+        the document element, are not written.
+
+        :param stream: A writable binary stream to output the SVG in chunks. If `None`, the output is returned.
+        :param minify: If `True`, comments and whitespace between tags are removed.
+        :returns: The serialized document as `bytes` if no stream is given, otherwise `None`.
         """
 
     def width(self) -> float:
@@ -534,24 +697,57 @@ class Document:
         Updates the layout of the document.
         """
 
-    def render(self, bitmap: Bitmap, matrix: Matrix = ...) -> None:
+    def render(self, bitmap: Bitmap, matrix: Matrix = ..., viewport: Optional[Box] = None, quality: float = 1.0) -> None:
         """
         Renders the document onto a bitmap using a transformation matrix.
 
+        When a viewport is given, the output is clipped to it and the rest of the bitmap is left
+        untouched. Only rasterization is limited to the viewport; every element is still traversed
+        and prepared, so that part of the cost does not shrink with the viewport.
+
         :param bitmap: The target bitmap for rendering.
         :param matrix: The root transformation matrix.
+        :param viewport: The region of the bitmap to render, in pixels.
+        :param quality: The resolution scale in (0, 1]. Values below 1 render at reduced resolution and
+            upsample the result, trading sharpness for speed in previews and thumbnails.
         """
 
-    def render_to_bitmap(self, width: int = -1, height: int = -1, background_color: int = 0x00000000) -> None:
+    def render_to_bitmap(self, width: int = -1, height: int = -1, background_color: int = 0x00000000, quality: float = 1.0) -> Bitmap:
         """
         Renders the document to a bitmap with specified dimensions.
 
         :param width: The desired width in pixels, or -1 to auto-scale based on the intrinsic size.
         :param height: The desired height in pixels, or -1 to auto-scale based on the intrinsic size.
         :param background_color: The background color in 0xRRGGBBAA format.
+        :param quality: The resolution scale in (0, 1], as for `render`.
         :returns: A `Bitmap` containing the raster representation of the document.
         """
 
+    def render_frames(self, keyframes: Sequence[Dict[str, Dict[str, str]]], width: int = -1, height: int = -1, background_color: int = 0x00000000, format: str = 'png', stream: Optional[BinaryIO] = None, delay: float = 0.1, loops: int = 0) -> Union[List[bytes], bytes, None]:
+        """
+        Renders a sequence of animation frames, applying attribute changes before each frame.
+
+        Frames are rendered into two recycled bitmaps, and each frame is encoded on a separate
+        thread while the next one is rendered. Attribute changes persist in the document after
+        the call returns.
+
+        With the 'apng' format, the frames are combined into a single animated PNG by repackaging
+        the compressed data of each frame, without encoding it again.
+
+        :param keyframes: A sequence with one entry per frame, each mapping element IDs to the attributes to set on them.
+        :param width: The desired width in pixels, or -1 to auto-scale based on the intrinsic size.
+        :param height: The desired height in pixels, or -1 to auto-scale based on the intrinsic size.
+        :param background_color: The background color in 0xRRGGBBAA format.
+        :param format: Either 'png' for PNG-encoded frames, 'apng' for an animated PNG, or 'raw' for unpadded premultiplied ARGB32 pixel data.
+        :param stream: A writable binary stream. If given, each frame (or each APNG frame's chunks) is written
+            to it as soon as it is encoded, so only two frames are held in memory at a time.
+        :param delay: The display time of each APNG frame in seconds.
+        :param loops: The number of times an APNG plays, or 0 to loop forever.
+        :returns: `None` if a stream is given. Otherwise the APNG data as `bytes` for the 'apng' format,
+            or a list containing the encoded data of each frame.
+        :raises ValueError: If a keyframe refers to an element ID that does not exist.
+        """
+
     def get_element_by_id(self, id: str) -> Optional[Element]:
         """
         Retrieves an element from the document by its ID.
@@ -571,6 +767,9 @@ def add_font_face_from_file(family: str, bold: bool, italic: bool, filename: Uni
     """
     Adds a font face to the font cache from a font file.
 
+    The file is memory-mapped rather than read into memory, so its pages are shared
+    with other processes using the same font.
+
     :param family: The name of the font family.
     :param bold: A boolean indicating if the font is bold.
     :param italic: A boolean indicating if the font is italic.
@@ -586,3 +785,29 @@ def add_font_face_from_data(family: str, bold: bool, italic: bool, data: memoryv
     :param italic: A boolean indicating if the font is italic.
     :param data: A `memoryview` object containing the font data.
     """
+
+def add_font_faces_from_directory(path: Union[str, bytes, os.PathLike], recursive: bool = True, index: Optional[Union[str, bytes, os.PathLike]] = None) -> List[Tuple[str, bool, bool, str]]:
+    """
+    Adds every TrueType and OpenType font file in a directory to the font cache.
+
+    Font files are memory-mapped and their headers are read in parallel. The family name and the
+    bold and italic flags are taken from the font's `name`, `OS/2` and `head` tables. Files that
+    cannot be parsed are skipped.
+
+    :param path: The path to the directory containing the font files.
+    :param recursive: A boolean indicating if subdirectories should be scanned as well. Each
+        directory is scanned at most once, even when reached through a symbolic link.
+    :param index: The path to an index file that caches the font headers by file size and
+        modification time, so later calls skip parsing unchanged files. The file is created or
+        updated as needed. If it cannot be written, a `RuntimeWarning` is issued and the fonts are
+        still added.
+    :returns: A list of `(family, bold, italic, filename)` tuples for the font faces that were added.
+    """
+
+def font_faces() -> List[Tuple[str, bool, bool, Optional[str]]]:
+    """
+    Returns the font faces added to the font cache.
+
+    :returns: A list of `(family, bold, italic, filename)` tuples in the order the faces were added,
+        where `filename` is `None` for faces added from data.
+    """
@@ -1,10 +1,28 @@
+import io
+import os
 import sys
+import glob
+import json
+import math
+import mmap
+import stat
+import time
+import signal
+import socket
+import struct
+import hashlib
 import argparse
+import threading
+import collections
+import socketserver
+import concurrent.futures
 import lunasvg
 
 parser = argparse.ArgumentParser(
     prog='lunasvg',
-    description='SVG rendering library.'
+    description='SVG rendering library.',
+    epilog='Run "lunasvg batch --help" to convert many files in one process, '
+           'or "lunasvg serve --help" to run a persistent render server.'
 )
 
 parser.add_argument(
@@ -47,11 +65,353 @@ parser.add_argument(
     help='Sets the background color in 0xRRGGBBAA format'
 )
 
+batch_parser = argparse.ArgumentParser(
+    prog='lunasvg batch',
+    description='Renders many SVG files to PNG in a single process.'
+)
+
+batch_parser.add_argument(
+    'inputs',
+    nargs='*',
+    help='input filenames or glob patterns, @FILE to read filenames from a manifest, or - to read filenames from stdin'
+)
+
+batch_parser.add_argument(
+    '-o', '--output',
+    default=None,
+    help='Sets the output filename template; available fields are {dir}, {name}, {stem}, {width} and {height} '
+         '(default: {dir}/{stem}.png, or {dir}/{stem}-{width}x{height}.png with several sizes)'
+)
+
+def str2size(x: str) -> tuple:
+    width, _, height = x.partition('x')
+    return (int(width) if width else -1, int(height) if height else -1)
+
+batch_parser.add_argument(
+    '--size',
+    type=str2size,
+    action='append',
+    help='Adds an output size as WIDTHxHEIGHT, WIDTH or xHEIGHT; may be given several times'
+)
+
+batch_parser.add_argument(
+    '--background',
+    type=str2hex,
+    default=0x00000000,
+    help='Sets the background color in 0xRRGGBBAA format'
+)
+
+batch_parser.add_argument(
+    '-j', '--jobs',
+    type=int,
+    default=os.cpu_count() or 1,
+    help='Sets the number of files rendered in parallel (default: number of CPUs)'
+)
+
+batch_parser.add_argument(
+    '--cache',
+    default=None,
+    help='Sets a file recording content hashes, used to skip inputs whose outputs are up to date'
+)
+
+def expand_inputs(patterns: list) -> list:
+    filenames = []
+    for pattern in patterns:
+        if pattern == '-':
+            filenames.extend(expand_inputs(line.strip() for line in sys.stdin if line.strip()))
+        elif pattern.startswith('@'):
+            with open(pattern[1:], 'r') as manifest:
+                filenames.extend(expand_inputs(line.strip() for line in manifest if line.strip()))
+        elif any(ch in pattern for ch in '*?['):
+            filenames.extend(sorted(glob.glob(pattern, recursive=True)))
+        else:
+            filenames.append(pattern)
+    return filenames
+
+def render_batch_input(filename: str, args: argparse.Namespace, template: str, cache: dict) -> str:
+    with open(filename, 'rb') as input_file:
+        data = input_file.read()
+
+    digest = hashlib.sha256(data)
+    digest.update(repr((args.size, args.background, template, lunasvg.LUNASVG_VERSION)).encode())
+    key = os.path.abspath(filename)
+    entry = cache.get(key)
+    if entry and entry['hash'] == digest.hexdigest() and all(os.path.exists(output) for output in entry['outputs']):
+        return 'skipped'
+
+    document = lunasvg.Document.load_from_data(data)
+    directory, name = os.path.split(filename)
+    outputs = []
+    for width, height in args.size:
+        bitmap = document.render_to_bitmap(width, height, args.background)
+        output = template.format(dir=directory or '.', name=name, stem=os.path.splitext(name)[0], width=bitmap.width(), height=bitmap.height())
+        os.makedirs(os.path.dirname(output) or '.', exist_ok=True)
+        bitmap.write_to_png(output)
+        outputs.append(output)
+
+    cache[key] = {'hash': digest.hexdigest(), 'outputs': outputs}
+    return 'rendered'
+
+def batch(args: argparse.Namespace) -> int:
+    filenames = expand_inputs(args.inputs)
+    if args.size is None:
+        args.size = [(-1, -1)]
+    template = args.output
+    if template is None:
+        template = '{dir}/{stem}.png' if len(args.size) == 1 else '{dir}/{stem}-{width}x{height}.png'
+
+    cache = {}
+    if args.cache and os.path.exists(args.cache):
+        with open(args.cache, 'r') as cache_file:
+            cache = json.load(cache_file)
+
+    counts = {'rendered': 0, 'skipped': 0, 'failed': 0}
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as executor:
+        futures = {executor.submit(render_batch_input, filename, args, template, cache): filename for filename in filenames}
+        for future in concurrent.futures.as_completed(futures):
+            try:
+                counts[future.result()] += 1
+            except Exception as error:
+                counts['failed'] += 1
+                print(f'lunasvg: {futures[future]}: {error}', file=sys.stderr)
+
+    if args.cache:
+        with open(args.cache, 'w') as cache_file:
+            json.dump(cache, cache_file)
+
+    print(f'{counts["rendered"]} rendered, {counts["skipped"]} skipped, {counts["failed"]} failed', file=sys.stderr)
+    return 1 if counts['failed'] else 0
+
+serve_parser = argparse.ArgumentParser(
+    prog='lunasvg serve',
+    description='Runs a render server that keeps documents, fonts and bitmaps warm between requests.'
+)
+
+serve_parser.add_argument(
+    '--socket',
+    required=True,
+    help='Sets the path of the Unix domain socket to listen on'
+)
+
+serve_parser.add_argument(
+    '--font-dir',
+    action='append',
+    default=[],
+    help='Adds a directory of fonts to register at startup; may be given several times'
+)
+
+serve_parser.add_argument(
+    '--font-index',
+    default=None,
+    help='Sets the font index file used to speed up font registration'
+)
+
+serve_parser.add_argument(
+    '--cache-size',
+    type=int,
+    default=64,
+    help='Sets the number of parsed documents kept in memory (default: 64)'
+)
+
+# Every message in either direction is a 4-byte big-endian length followed by a JSON header.
+# A request header holds either "path" (an SVG file on the server) or "length" (the size of the
+# SVG data that follows the header), plus optional "width", "height", "background",
+# "format" ("png" or "raw") and "fd". The response header holds "status", "error", "width",
+# "height", "stride", "format", "length" and "timings" (in milliseconds), followed by "length"
+# bytes of output. When "fd" is true the output is instead passed as a memfd with the header.
+
+def recv_exact(sock: socket.socket, size: int):
+    buffer = bytearray(size)
+    view = memoryview(buffer)
+    while view:
+        count = sock.recv_into(view)
+        if count == 0:
+            return None
+        view = view[count:]
+    return buffer
+
+def recv_message(sock: socket.socket):
+    prefix = recv_exact(sock, 4)
+    if prefix is None:
+        return None
+    return json.loads(recv_exact(sock, struct.unpack('>I', prefix)[0]))
+
+def send_message(sock: socket.socket, header: dict, fd: int = -1) -> None:
+    data = json.dumps(header).encode()
+    message = struct.pack('>I', len(data)) + data
+    if fd == -1:
+        sock.sendall(message)
+    else:
+        sock.sendmsg([message], [(socket.SOL_SOCKET, socket.SCM_RIGHTS, struct.pack('i', fd))])
+
+def document_size(document: lunasvg.Document, width: int, height: int) -> tuple:
+    intrinsic_width, intrinsic_height = document.width(), document.height()
+    if intrinsic_width == 0 or intrinsic_height == 0:
+        raise ValueError('invalid document size')
+    if width <= 0 and height <= 0:
+        width, height = math.ceil(intrinsic_width), math.ceil(intrinsic_height)
+    elif height <= 0:
+        height = math.ceil(width * intrinsic_height / intrinsic_width)
+    elif width <= 0:
+        width = math.ceil(height * intrinsic_width / intrinsic_height)
+    return width, height
+
+if hasattr(socket, 'AF_UNIX'):
+    class RenderServer(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+        daemon_threads = True
+
+        def __init__(self, path: str, cache_size: int) -> None:
+            super().__init__(path, RenderHandler)
+            self.cache_size = max(1, cache_size)
+            self.documents = collections.OrderedDict()
+            self.documents_lock = threading.Lock()
+            self.bitmaps = threading.local()
+
+        def load_document(self, request: dict, data) -> tuple:
+            if data is not None:
+                key = hashlib.sha256(data).digest()
+            else:
+                path = os.path.realpath(request['path'])
+                key = (path, os.stat(path).st_mtime_ns)
+            with self.documents_lock:
+                entry = self.documents.get(key)
+                if entry is not None:
+                    self.documents.move_to_end(key)
+                    return entry
+            document = lunasvg.Document.load_from_data(bytes(data)) if data is not None else lunasvg.Document(path)
+            entry = (document, threading.Lock())
+            with self.documents_lock:
+                entry = self.documents.setdefault(key, entry)
+                while len(self.documents) > self.cache_size:
+                    self.documents.popitem(last=False)
+            return entry
+
+        def recycled_bitmap(self, width: int, height: int) -> lunasvg.Bitmap:
+            bitmap = getattr(self.bitmaps, 'bitmap', None)
+            if bitmap is None or bitmap.width() != width or bitmap.height() != height:
+                bitmap = self.bitmaps.bitmap = lunasvg.Bitmap(width, height)
+            return bitmap
+
+        def render(self, sock: socket.socket, request: dict, data) -> None:
+            start = time.perf_counter()
+            document, lock = self.load_document(request, data)
+            loaded = time.perf_counter()
+
+            output_format = request.get('format', 'png')
+            if output_format not in ('png', 'raw'):
+                raise ValueError("format must be 'png' or 'raw'")
+            use_fd = bool(request.get('fd', False))
+            fd, mapping, bitmap, payload = -1, None, None, None
+            try:
+                with lock:
+                    width, height = document_size(document, request.get('width', -1), request.get('height', -1))
+                    if use_fd:
+                        fd = os.memfd_create('lunasvg')
+                    if use_fd and output_format == 'raw':
+                        os.ftruncate(fd, width * height * 4)
+                        mapping = mmap.mmap(fd, width * height * 4)
+                        bitmap = lunasvg.Bitmap.create_for_data(mapping, width, height, width * 4)
+                    else:
+                        bitmap = self.recycled_bitmap(width, height)
+                    bitmap.clear(request.get('background', 0))
+                    document.render(bitmap, lunasvg.Matrix(width / document.width(), 0, 0, height / document.height(), 0, 0))
+                rendered = time.perf_counter()
+
+                if output_format == 'raw':
+                    payload = bitmap.data()
+                elif use_fd:
+                    with os.fdopen(os.dup(fd), 'wb') as output_file:
+                        bitmap.write_to_png_stream(output_file)
+                else:
+                    output_file = io.BytesIO()
+                    bitmap.write_to_png_stream(output_file)
+                    payload = output_file.getbuffer()
+                encoded = time.perf_counter()
+
+                header = {
+                    'status': 'ok',
+                    'width': width,
+                    'height': height,
+                    'stride': width * 4,
+                    'format': output_format,
+                    'length': os.fstat(fd).st_size if use_fd else len(payload),
+                    'timings': {
+                        'load': (loaded - start) * 1000,
+                        'render': (rendered - loaded) * 1000,
+                        'encode': (encoded - rendered) * 1000
+                    }
+                }
+
+                if use_fd:
+                    os.lseek(fd, 0, os.SEEK_SET)
+                send_message(sock, header, fd)
+                if not use_fd:
+                    sock.sendall(payload)
+            finally:
+                bitmap = payload = None
+                if mapping is not None:
+                    mapping.close()
+                if fd != -1:
+                    os.close(fd)
+
+    class RenderHandler(socketserver.BaseRequestHandler):
+        def handle(self) -> None:
+            while True:
+                try:
+                    request = recv_message(self.request)
+                except (OSError, ValueError):
+                    return
+                if request is None:
+                    return
+                try:
+                    data = None
+                    if 'length' in request:
+                        data = recv_exact(self.request, request['length'])
+                        if data is None:
+                            return
+                    self.server.render(self.request, request, data)
+                except OSError as error:
+                    if isinstance(error, (BrokenPipeError, ConnectionResetError)):
+                        return
+                    send_message(self.request, {'status': 'error', 'error': str(error)})
+                except Exception as error:
+                    send_message(self.request, {'status': 'error', 'error': str(error)})
+
+def serve(args: argparse.Namespace) -> int:
+    if not hasattr(socket, 'AF_UNIX'):
+        print('lunasvg: serve requires Unix domain sockets', file=sys.stderr)
+        return 1
+
+    for font_dir in args.font_dir:
+        lunasvg.add_font_faces_from_directory(font_dir, index=args.font_index)
+
+    try:
+        if not stat.S_ISSOCK(os.lstat(args.socket).st_mode):
+            print(f'lunasvg: {args.socket} exists and is not a socket', file=sys.stderr)
+            return 1
+        os.unlink(args.socket)
+    except FileNotFoundError:
+        pass
+    signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
+    with RenderServer(args.socket, args.cache_size) as server:
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+        finally:
+            os.unlink(args.socket)
+    return 0
+
 def main() -> int:
+    if sys.argv[1:2] == ['batch']:
+        return batch(batch_parser.parse_args(sys.argv[2:]))
+    if sys.argv[1:2] == ['serve']:
+        return serve(serve_parser.parse_args(sys.argv[2:]))
+
     args = parser.parse_args()
 
-    input_file = sys.stdin if args.input == '-' else open(args.input, 'r')
-    output_file = sys.stdout if args.output == '-' else open(args.output, 'wb')
+    input_file = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb')
+    output_file = sys.stdout.buffer if args.output == '-' else open(args.output, 'wb')
 
     document = lunasvg.Document.load_from_data(input_file.read())
     bitmap = document.render_to_bitmap(args.width, args.height, args.background)
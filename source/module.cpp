@@ -1,8 +1,63 @@
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#endif
+
 #include <lunasvg.h>
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <structmember.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PYLUNASVG_USE_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PYLUNASVG_USE_NEON
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+template<typename Func>
+static void parallel_for(size_t count, Func func)
+{
+    size_t num_threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next_index(0);
+    auto worker = [&]() {
+        size_t index;
+        while((index = next_index++) < count) {
+            func(index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < num_threads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for(auto& thread : threads) {
+        thread.join();
+    }
+}
+
 static PyTypeObject Bitmap_Type = { PyVarObject_HEAD_INIT(nullptr, 0) };
 static PyTypeObject Matrix_Type = { PyVarObject_HEAD_INIT(nullptr, 0) };
 static PyTypeObject Box_Type = { PyVarObject_HEAD_INIT(nullptr, 0) };
@@ -13,6 +68,9 @@ typedef struct {
     PyObject_HEAD
     PyObject* data;
     lunasvg::Bitmap bitmap;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+    bool flat_export;
 } Bitmap_Object;
 
 static PyObject* Bitmap_Create(PyObject* data, lunasvg::Bitmap bitmap)
@@ -20,6 +78,13 @@ static PyObject* Bitmap_Create(PyObject* data, lunasvg::Bitmap bitmap)
     Bitmap_Object* bitmap_ob = PyObject_New(Bitmap_Object, &Bitmap_Type);
     new (&bitmap_ob->bitmap) lunasvg::Bitmap(std::move(bitmap));
     bitmap_ob->data = data;
+    bitmap_ob->shape[0] = bitmap_ob->bitmap.height();
+    bitmap_ob->shape[1] = bitmap_ob->bitmap.width();
+    bitmap_ob->shape[2] = 4;
+    bitmap_ob->strides[0] = bitmap_ob->bitmap.stride();
+    bitmap_ob->strides[1] = 4;
+    bitmap_ob->strides[2] = 1;
+    bitmap_ob->flat_export = false;
     Py_XINCREF(bitmap_ob->data);
     return (PyObject*)bitmap_ob;
 }
@@ -51,30 +116,242 @@ static PyObject* Bitmap_create_for_data(PyTypeObject* type, PyObject* args)
     int width, height, stride;
     if(!PyArg_ParseTuple(args, "Oiii", &data, &width, &height, &stride))
         return nullptr;
-    Py_buffer buffer;
-    if(PyObject_GetBuffer(data, &buffer, PyBUF_WRITABLE) == -1)
+    PyObject* view_ob = PyMemoryView_FromObject(data);
+    if(view_ob == nullptr)
         return nullptr;
-    if(height * stride > buffer.len) {
-        PyBuffer_Release(&buffer);
+    Py_buffer* buffer = PyMemoryView_GET_BUFFER(view_ob);
+    if(buffer->readonly) {
+        Py_DECREF(view_ob);
+        PyErr_SetString(PyExc_TypeError, "buffer is not writable");
+        return nullptr;
+    }
+
+    if(!PyBuffer_IsContiguous(buffer, 'A')) {
+        Py_DECREF(view_ob);
+        PyErr_SetString(PyExc_ValueError, "buffer is not contiguous");
+        return nullptr;
+    }
+
+    if((Py_ssize_t)height * stride > buffer->len) {
+        Py_DECREF(view_ob);
         PyErr_SetString(PyExc_ValueError, "buffer is not long enough");
         return nullptr;
     }
 
-    lunasvg::Bitmap bitmap((uint8_t*)buffer.buf, width, height, stride);
+    lunasvg::Bitmap bitmap((uint8_t*)buffer->buf, width, height, stride);
     if(bitmap.isNull()) {
-        PyBuffer_Release(&buffer);
+        Py_DECREF(view_ob);
         PyErr_SetString(PyExc_MemoryError, "out of memory");
         return nullptr;
     }
 
-    PyObject* bitmap_ob = Bitmap_Create(nullptr, std::move(bitmap));
-    PyBuffer_Release(&buffer);
+    PyObject* bitmap_ob = Bitmap_Create(view_ob, std::move(bitmap));
+    Py_DECREF(view_ob);
+    return bitmap_ob;
+}
+
+typedef struct {
+    uint32_t magic;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+} SharedBitmapHeader;
+
+static const uint32_t SharedBitmapMagic = 0x4C535642;
+
+typedef struct {
+    void* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE handle;
+#endif
+} MemoryMapping;
+
+static const char* MemoryMapping_Name = "lunasvg.MemoryMapping";
+
+static void memory_mapping_free(void* closure)
+{
+    MemoryMapping* mapping = (MemoryMapping*)closure;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping->data);
+    CloseHandle(mapping->handle);
+#else
+    munmap(mapping->data, mapping->size);
+#endif
+    PyMem_RawFree(mapping);
+}
+
+static void memory_mapping_destroy(PyObject* capsule)
+{
+    memory_mapping_free(PyCapsule_GetPointer(capsule, MemoryMapping_Name));
+}
+
+static PyObject* filename_error(const char* name)
+{
+#ifdef _WIN32
+    return PyErr_SetExcFromWindowsErrWithFilename(PyExc_OSError, 0, name);
+#else
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+#endif
+}
+
+static PyObject* shared_mapping_open(const char* name, size_t size, bool create)
+{
+#ifdef _WIN32
+    HANDLE handle;
+    if(create) {
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name);
+        if(handle && GetLastError() == ERROR_ALREADY_EXISTS) {
+            CloseHandle(handle);
+            PyErr_SetString(PyExc_FileExistsError, name);
+            return nullptr;
+        }
+    } else {
+        handle = OpenFileMappingA(FILE_MAP_WRITE, FALSE, name);
+    }
+
+    if(handle == nullptr)
+        return filename_error(name);
+    void* data = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, size);
+    if(data == nullptr) {
+        CloseHandle(handle);
+        return filename_error(name);
+    }
+
+    if(!create) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(data, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+#else
+    std::string path(name);
+    if(path.empty() || path[0] != '/')
+        path.insert(0, 1, '/');
+    int fd = shm_open(path.data(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+    if(fd == -1)
+        return filename_error(name);
+    if(create && ftruncate(fd, size) == -1) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+        shm_unlink(path.data());
+        close(fd);
+        return nullptr;
+    }
+
+    if(!create) {
+        struct stat st;
+        if(fstat(fd, &st) == -1) {
+            close(fd);
+            return filename_error(name);
+        }
+
+        size = st.st_size;
+    }
+
+    void* data = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(data == MAP_FAILED) {
+        if(create)
+            shm_unlink(path.data());
+        return filename_error(name);
+    }
+#endif
+
+    MemoryMapping* mapping = (MemoryMapping*)PyMem_RawMalloc(sizeof(MemoryMapping));
+    if(mapping == nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(handle);
+#else
+        munmap(data, size);
+#endif
+        return PyErr_NoMemory();
+    }
+
+    mapping->data = data;
+    mapping->size = size;
+#ifdef _WIN32
+    mapping->handle = handle;
+#endif
+    PyObject* capsule = PyCapsule_New(mapping, MemoryMapping_Name, memory_mapping_destroy);
+    if(capsule == nullptr)
+        memory_mapping_free(mapping);
+    return capsule;
+}
+
+static PyObject* Bitmap_create_shared(PyTypeObject* type, PyObject* args)
+{
+    const char* name;
+    int width, height;
+    if(!PyArg_ParseTuple(args, "sii", &name, &width, &height))
+        return nullptr;
+    if(width <= 0 || height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "invalid bitmap size");
+        return nullptr;
+    }
+
+    int stride = width * 4;
+    PyObject* mapping_ob = shared_mapping_open(name, sizeof(SharedBitmapHeader) + (size_t)height * stride, true);
+    if(mapping_ob == nullptr)
+        return nullptr;
+    MemoryMapping* mapping = (MemoryMapping*)PyCapsule_GetPointer(mapping_ob, MemoryMapping_Name);
+    SharedBitmapHeader* header = (SharedBitmapHeader*)mapping->data;
+    header->magic = SharedBitmapMagic;
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+
+    lunasvg::Bitmap bitmap((uint8_t*)(header + 1), width, height, stride);
+    PyObject* bitmap_ob = Bitmap_Create(mapping_ob, std::move(bitmap));
+    Py_DECREF(mapping_ob);
+    return bitmap_ob;
+}
+
+static PyObject* Bitmap_attach_shared(PyTypeObject* type, PyObject* args)
+{
+    const char* name;
+    if(!PyArg_ParseTuple(args, "s", &name))
+        return nullptr;
+    PyObject* mapping_ob = shared_mapping_open(name, 0, false);
+    if(mapping_ob == nullptr)
+        return nullptr;
+    MemoryMapping* mapping = (MemoryMapping*)PyCapsule_GetPointer(mapping_ob, MemoryMapping_Name);
+    SharedBitmapHeader* header = (SharedBitmapHeader*)mapping->data;
+    if(mapping->size < sizeof(SharedBitmapHeader) || header->magic != SharedBitmapMagic
+        || header->width <= 0 || header->height <= 0 || header->stride < header->width * 4
+        || mapping->size - sizeof(SharedBitmapHeader) < (size_t)header->height * header->stride) {
+        Py_DECREF(mapping_ob);
+        PyErr_SetString(PyExc_ValueError, "shared memory segment does not contain a bitmap");
+        return nullptr;
+    }
+
+    lunasvg::Bitmap bitmap((uint8_t*)(header + 1), header->width, header->height, header->stride);
+    PyObject* bitmap_ob = Bitmap_Create(mapping_ob, std::move(bitmap));
+    Py_DECREF(mapping_ob);
     return bitmap_ob;
 }
 
+static PyObject* Bitmap_unlink_shared(PyTypeObject* type, PyObject* args)
+{
+    const char* name;
+    if(!PyArg_ParseTuple(args, "s", &name))
+        return nullptr;
+#ifndef _WIN32
+    std::string path(name);
+    if(path.empty() || path[0] != '/')
+        path.insert(0, 1, '/');
+    if(shm_unlink(path.data()) == -1) {
+        return filename_error(name);
+    }
+#endif
+    Py_RETURN_NONE;
+}
+
 static PyObject* Bitmap_data(Bitmap_Object* self, PyObject* args)
 {
-    return PyMemoryView_FromObject((PyObject*)self);
+    self->flat_export = true;
+    PyObject* view_ob = PyMemoryView_FromObject((PyObject*)self);
+    self->flat_export = false;
+    return view_ob;
 }
 
 static PyObject* Bitmap_width(Bitmap_Object* self, PyObject* args)
@@ -84,7 +361,7 @@ static PyObject* Bitmap_width(Bitmap_Object* self, PyObject* args)
 
 static PyObject* Bitmap_height(Bitmap_Object* self, PyObject* args)
 {
-    return PyLong_FromLong(self->bitmap.width());
+    return PyLong_FromLong(self->bitmap.height());
 }
 
 static PyObject* Bitmap_stride(Bitmap_Object* self, PyObject* args)
@@ -149,6 +426,38 @@ static int stream_write_conv(PyObject* ob, PyObject** target)
     return 0;
 }
 
+struct StreamClosure {
+    PyObject* write_ob;
+    bool failed;
+    PyObject* error_type;
+    PyObject* error_value;
+    PyObject* error_traceback;
+};
+
+static void stream_closure_write_func(void* closure, void* data, int length)
+{
+    StreamClosure* stream = (StreamClosure*)closure;
+    if(stream->failed)
+        return;
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject* result = PyObject_CallFunction(stream->write_ob, "(y#)", data, (Py_ssize_t)length);
+    if(result == nullptr) {
+        PyErr_Fetch(&stream->error_type, &stream->error_value, &stream->error_traceback);
+        stream->failed = true;
+    }
+
+    Py_XDECREF(result);
+    PyGILState_Release(gstate);
+}
+
+static bool stream_closure_restore(StreamClosure* stream)
+{
+    if(!stream->failed)
+        return false;
+    PyErr_Restore(stream->error_type, stream->error_value, stream->error_traceback);
+    return true;
+}
+
 static PyObject* Bitmap_write_to_png_stream(Bitmap_Object* self, PyObject* args)
 {
     PyObject* write_ob;
@@ -172,9 +481,41 @@ static PyObject* Bitmap_write_to_png_stream(Bitmap_Object* self, PyObject* args)
 static int Bitmap__getbuffer__(Bitmap_Object* self, Py_buffer* view, int flags)
 {
     void* data = self->bitmap.data();
+    int width = self->bitmap.width();
     int height = self->bitmap.height();
     int stride = self->bitmap.stride();
-    return PyBuffer_FillInfo(view, (PyObject*)self, data, height * stride, 0, flags);
+    if(self->flat_export || (flags & PyBUF_ND) != PyBUF_ND)
+        return PyBuffer_FillInfo(view, (PyObject*)self, data, height * stride, 0, flags);
+    if(stride != width * 4) {
+        if((flags & PyBUF_STRIDES) != PyBUF_STRIDES) {
+            PyErr_SetString(PyExc_BufferError, "bitmap rows are padded and require a strided buffer");
+            return -1;
+        }
+
+        if((flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS || (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS) {
+            PyErr_SetString(PyExc_BufferError, "bitmap rows are padded and not contiguous");
+            return -1;
+        }
+    }
+
+    if((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS) {
+        PyErr_SetString(PyExc_BufferError, "bitmap is not Fortran contiguous");
+        return -1;
+    }
+
+    view->buf = data;
+    view->obj = (PyObject*)self;
+    view->len = (Py_ssize_t)height * width * 4;
+    view->readonly = 0;
+    view->itemsize = 1;
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char*)"B" : nullptr;
+    view->ndim = 3;
+    view->shape = self->shape;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    Py_INCREF(self);
+    return 0;
 }
 
 static PyBufferProcs Bitmap_as_buffer = {
@@ -182,8 +523,354 @@ static PyBufferProcs Bitmap_as_buffer = {
     nullptr
 };
 
+static PyObject* Bitmap_get_array_interface(Bitmap_Object* self, void* closure)
+{
+    PyObject* strides_ob;
+    if(self->bitmap.stride() == self->bitmap.width() * 4) {
+        strides_ob = Py_None;
+        Py_INCREF(strides_ob);
+    } else {
+        strides_ob = Py_BuildValue("(nnn)", self->strides[0], self->strides[1], self->strides[2]);
+    }
+
+    return Py_BuildValue("{s:(nnn),s:s,s:(NO),s:N,s:i}",
+        "shape", self->shape[0], self->shape[1], self->shape[2],
+        "typestr", "|u1",
+        "data", PyLong_FromVoidPtr(self->bitmap.data()), Py_False,
+        "strides", strides_ob,
+        "version", 3);
+}
+
+static PyGetSetDef Bitmap_getset[] = {
+    {"__array_interface__", (getter)Bitmap_get_array_interface, nullptr, nullptr, nullptr},
+    {nullptr}
+};
+
+typedef struct {
+    int32_t device_type;
+    int32_t device_id;
+} DLDevice;
+
+typedef struct {
+    uint8_t code;
+    uint8_t bits;
+    uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+    void* data;
+    DLDevice device;
+    int32_t ndim;
+    DLDataType dtype;
+    int64_t* shape;
+    int64_t* strides;
+    uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+    DLTensor dl_tensor;
+    void* manager_ctx;
+    void (*deleter)(struct DLManagedTensor* self);
+} DLManagedTensor;
+
+typedef struct {
+    DLManagedTensor tensor;
+    int64_t shape[3];
+    int64_t strides[3];
+} BitmapTensor;
+
+static const int32_t DLDeviceType_CPU = 1;
+static const uint8_t DLDataTypeCode_UInt = 1;
+
+static void dlpack_tensor_deleter(DLManagedTensor* tensor)
+{
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    Py_XDECREF((PyObject*)tensor->manager_ctx);
+    PyGILState_Release(gstate);
+    PyMem_RawFree(tensor);
+}
+
+static void dlpack_capsule_destructor(PyObject* capsule)
+{
+    if(PyCapsule_IsValid(capsule, "used_dltensor"))
+        return;
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    DLManagedTensor* tensor = (DLManagedTensor*)PyCapsule_GetPointer(capsule, "dltensor");
+    if(tensor == nullptr) {
+        PyErr_WriteUnraisable(capsule);
+    } else if(tensor->deleter) {
+        tensor->deleter(tensor);
+    }
+
+    PyErr_Restore(type, value, traceback);
+}
+
+static PyObject* Bitmap__dlpack__(Bitmap_Object* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "stream", "max_version", "dl_device", "copy", nullptr };
+    PyObject* stream_ob = Py_None;
+    PyObject* max_version_ob = Py_None;
+    PyObject* dl_device_ob = Py_None;
+    PyObject* copy_ob = Py_None;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|$OOOO", (char**)kwlist, &stream_ob, &max_version_ob, &dl_device_ob, &copy_ob)) {
+        return nullptr;
+    }
+
+    if(copy_ob == Py_True) {
+        PyErr_SetString(PyExc_BufferError, "Bitmap cannot export a copy through DLPack");
+        return nullptr;
+    }
+
+    BitmapTensor* tensor = (BitmapTensor*)PyMem_RawMalloc(sizeof(BitmapTensor));
+    if(tensor == nullptr)
+        return PyErr_NoMemory();
+    for(int i = 0; i < 3; ++i) {
+        tensor->shape[i] = self->shape[i];
+        tensor->strides[i] = self->strides[i];
+    }
+
+    DLTensor& dl_tensor = tensor->tensor.dl_tensor;
+    dl_tensor.data = self->bitmap.data();
+    dl_tensor.device.device_type = DLDeviceType_CPU;
+    dl_tensor.device.device_id = 0;
+    dl_tensor.ndim = 3;
+    dl_tensor.dtype.code = DLDataTypeCode_UInt;
+    dl_tensor.dtype.bits = 8;
+    dl_tensor.dtype.lanes = 1;
+    dl_tensor.shape = tensor->shape;
+    dl_tensor.strides = tensor->strides;
+    dl_tensor.byte_offset = 0;
+    tensor->tensor.manager_ctx = self;
+    tensor->tensor.deleter = dlpack_tensor_deleter;
+
+    PyObject* capsule = PyCapsule_New(tensor, "dltensor", dlpack_capsule_destructor);
+    if(capsule == nullptr) {
+        PyMem_RawFree(tensor);
+        return nullptr;
+    }
+
+    Py_INCREF(self);
+    return capsule;
+}
+
+static PyObject* Bitmap__dlpack_device__(Bitmap_Object* self, PyObject* args)
+{
+    return Py_BuildValue("(ii)", DLDeviceType_CPU, 0);
+}
+
+struct BitmapDiffStats {
+    uint64_t mismatched = 0;
+    uint64_t squared_error = 0;
+    int max_delta = 0;
+    double ssim = 0.0;
+    size_t blocks = 0;
+};
+
+static inline int bitmap_diff_luma(uint32_t pixel)
+{
+    return (((pixel >> 16) & 0xFF) * 77 + ((pixel >> 8) & 0xFF) * 150 + (pixel & 0xFF) * 29) >> 8;
+}
+
+static inline uint32_t bitmap_diff_pixel(uint32_t pixel, bool mismatched)
+{
+    if(mismatched)
+        return 0xFFFF0000;
+    int luma = std::min(255, bitmap_diff_luma(pixel) + 255 - (int)(pixel >> 24));
+    uint32_t faded = 255 - (255 - luma) / 4;
+    return 0xFF000000 | faded << 16 | faded << 8 | faded;
+}
+
+static void bitmap_diff_row(const uint32_t* a, const uint32_t* b, uint32_t* output, int width, int threshold, BitmapDiffStats& stats)
+{
+    int x = 0;
+#if defined(PYLUNASVG_USE_SSE2)
+    static const int mismatch_counts[16] = { 4, 3, 3, 2, 3, 2, 2, 1, 3, 2, 2, 1, 2, 1, 1, 0 };
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8((char)threshold);
+    __m128i max_delta = zero;
+    __m128i squared_error = zero;
+    int pending = 0;
+    for(; x + 4 <= width; x += 4) {
+        __m128i pa = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i pb = _mm_loadu_si128((const __m128i*)(b + x));
+        __m128i delta = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+        max_delta = _mm_max_epu8(max_delta, delta);
+        __m128i within = _mm_cmpeq_epi32(_mm_subs_epu8(delta, limit), zero);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(within));
+        stats.mismatched += mismatch_counts[mask];
+        __m128i lo = _mm_unpacklo_epi8(delta, zero);
+        __m128i hi = _mm_unpackhi_epi8(delta, zero);
+        squared_error = _mm_add_epi32(squared_error, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        if(++pending == 4096) {
+            uint32_t lanes[4];
+            _mm_storeu_si128((__m128i*)lanes, squared_error);
+            stats.squared_error += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            squared_error = zero;
+            pending = 0;
+        }
+
+        if(output) {
+            for(int i = 0; i < 4; ++i) {
+                output[x + i] = bitmap_diff_pixel(a[x + i], !(mask & (1 << i)));
+            }
+        }
+    }
+
+    uint8_t delta_bytes[16];
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)delta_bytes, max_delta);
+    _mm_storeu_si128((__m128i*)lanes, squared_error);
+    stats.squared_error += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    stats.max_delta = std::max<int>(stats.max_delta, *std::max_element(delta_bytes, delta_bytes + 16));
+#endif
+    for(; x < width; ++x) {
+        int pixel_delta = 0;
+        for(int shift = 0; shift < 32; shift += 8) {
+            int delta = std::abs((int)((a[x] >> shift) & 0xFF) - (int)((b[x] >> shift) & 0xFF));
+            pixel_delta = std::max(pixel_delta, delta);
+            stats.squared_error += delta * delta;
+        }
+
+        stats.max_delta = std::max(stats.max_delta, pixel_delta);
+        if(pixel_delta > threshold)
+            stats.mismatched++;
+        if(output) {
+            output[x] = bitmap_diff_pixel(a[x], pixel_delta > threshold);
+        }
+    }
+}
+
+static double bitmap_diff_ssim(double sum_a, double sum_b, double sum_aa, double sum_bb, double sum_ab, double n)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double mean_a = sum_a / n;
+    double mean_b = sum_b / n;
+    double var_a = sum_aa / n - mean_a * mean_a;
+    double var_b = sum_bb / n - mean_b * mean_b;
+    double cov = sum_ab / n - mean_a * mean_b;
+    return ((2 * mean_a * mean_b + c1) * (2 * cov + c2)) / ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+}
+
+static double bitmap_diff_ssim_block(const uint8_t* a, int stride_a, const uint8_t* b, int stride_b, int width, int height)
+{
+    double luma[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    double alpha[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    for(int y = 0; y < height; ++y) {
+        const uint32_t* row_a = (const uint32_t*)(a + y * stride_a);
+        const uint32_t* row_b = (const uint32_t*)(b + y * stride_b);
+        for(int x = 0; x < width; ++x) {
+            double la = bitmap_diff_luma(row_a[x]);
+            double lb = bitmap_diff_luma(row_b[x]);
+            double aa = row_a[x] >> 24;
+            double ab = row_b[x] >> 24;
+            luma[0] += la;
+            luma[1] += lb;
+            luma[2] += la * la;
+            luma[3] += lb * lb;
+            luma[4] += la * lb;
+            alpha[0] += aa;
+            alpha[1] += ab;
+            alpha[2] += aa * aa;
+            alpha[3] += ab * ab;
+            alpha[4] += aa * ab;
+        }
+    }
+
+    double n = width * height;
+    double luma_ssim = bitmap_diff_ssim(luma[0], luma[1], luma[2], luma[3], luma[4], n);
+    double alpha_ssim = bitmap_diff_ssim(alpha[0], alpha[1], alpha[2], alpha[3], alpha[4], n);
+    return (luma_ssim + alpha_ssim) / 2.0;
+}
+
+static PyObject* Bitmap_diff(Bitmap_Object* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "other", "threshold", "diff", nullptr };
+    Bitmap_Object* other_ob;
+    int threshold = 0;
+    int diff = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!|ip", (char**)kwlist, &Bitmap_Type, &other_ob, &threshold, &diff)) {
+        return nullptr;
+    }
+
+    const lunasvg::Bitmap& a = self->bitmap;
+    const lunasvg::Bitmap& b = other_ob->bitmap;
+    if(a.width() != b.width() || a.height() != b.height()) {
+        PyErr_SetString(PyExc_ValueError, "bitmaps must have the same size");
+        return nullptr;
+    }
+
+    if(threshold < 0 || threshold > 255) {
+        PyErr_SetString(PyExc_ValueError, "threshold must be between 0 and 255");
+        return nullptr;
+    }
+
+    lunasvg::Bitmap output;
+    if(diff) {
+        output = lunasvg::Bitmap(a.width(), a.height());
+        if(output.isNull()) {
+            PyErr_SetString(PyExc_MemoryError, "out of memory");
+            return nullptr;
+        }
+    }
+
+    const int block_size = 8;
+    int width = a.width();
+    int height = a.height();
+    size_t block_rows = (height + block_size - 1) / block_size;
+    std::vector<BitmapDiffStats> results(block_rows);
+    Py_BEGIN_ALLOW_THREADS
+    parallel_for(block_rows, [&](size_t index) {
+        BitmapDiffStats& stats = results[index];
+        int y0 = index * block_size;
+        int y1 = std::min(y0 + block_size, height);
+        for(int y = y0; y < y1; ++y) {
+            const uint32_t* row_a = (const uint32_t*)(a.data() + y * a.stride());
+            const uint32_t* row_b = (const uint32_t*)(b.data() + y * b.stride());
+            uint32_t* row_output = output.isNull() ? nullptr : (uint32_t*)(output.data() + y * output.stride());
+            bitmap_diff_row(row_a, row_b, row_output, width, threshold, stats);
+        }
+
+        for(int x = 0; x < width; x += block_size) {
+            const uint8_t* block_a = a.data() + y0 * a.stride() + x * 4;
+            const uint8_t* block_b = b.data() + y0 * b.stride() + x * 4;
+            stats.ssim += bitmap_diff_ssim_block(block_a, a.stride(), block_b, b.stride(), std::min(block_size, width - x), y1 - y0);
+            stats.blocks++;
+        }
+    });
+    Py_END_ALLOW_THREADS
+
+    BitmapDiffStats total;
+    for(const auto& stats : results) {
+        total.mismatched += stats.mismatched;
+        total.squared_error += stats.squared_error;
+        total.max_delta = std::max(total.max_delta, stats.max_delta);
+        total.ssim += stats.ssim;
+        total.blocks += stats.blocks;
+    }
+
+    double samples = 4.0 * width * height;
+    double psnr = Py_HUGE_VAL;
+    if(total.squared_error > 0)
+        psnr = 10.0 * std::log10(255.0 * 255.0 * samples / total.squared_error);
+    double ssim = total.blocks > 0 ? total.ssim / total.blocks : 1.0;
+
+    PyObject* diff_ob = Py_None;
+    if(diff) {
+        diff_ob = Bitmap_Create(nullptr, std::move(output));
+    } else {
+        Py_INCREF(diff_ob);
+    }
+
+    return Py_BuildValue("(KiddN)", (unsigned long long)total.mismatched, total.max_delta, psnr, ssim, diff_ob);
+}
+
 static PyMethodDef Bitmap_methods[] = {
     {"create_for_data", (PyCFunction)Bitmap_create_for_data, METH_VARARGS | METH_CLASS},
+    {"create_shared", (PyCFunction)Bitmap_create_shared, METH_VARARGS | METH_CLASS},
+    {"attach_shared", (PyCFunction)Bitmap_attach_shared, METH_VARARGS | METH_CLASS},
+    {"unlink_shared", (PyCFunction)Bitmap_unlink_shared, METH_VARARGS | METH_CLASS},
     {"data", (PyCFunction)Bitmap_data, METH_NOARGS},
     {"width", (PyCFunction)Bitmap_width, METH_NOARGS},
     {"height", (PyCFunction)Bitmap_height, METH_NOARGS},
@@ -191,6 +878,9 @@ static PyMethodDef Bitmap_methods[] = {
     {"clear", (PyCFunction)Bitmap_clear, METH_VARARGS},
     {"write_to_png", (PyCFunction)Bitmap_write_to_png, METH_VARARGS},
     {"write_to_png_stream", (PyCFunction)Bitmap_write_to_png_stream, METH_VARARGS},
+    {"diff", (PyCFunction)Bitmap_diff, METH_VARARGS | METH_KEYWORDS},
+    {"__dlpack__", (PyCFunction)Bitmap__dlpack__, METH_VARARGS | METH_KEYWORDS},
+    {"__dlpack_device__", (PyCFunction)Bitmap__dlpack_device__, METH_NOARGS},
     {nullptr}
 };
 
@@ -392,6 +1082,145 @@ static PyObject* Matrix_reset(Matrix_Object* self, PyObject* args)
     Py_RETURN_NONE;
 }
 
+static void map_points(const lunasvg::Matrix& matrix, const float* points, float* output, Py_ssize_t count)
+{
+    Py_ssize_t index = 0;
+#if defined(PYLUNASVG_USE_SSE2)
+    const __m128 ab = _mm_setr_ps(matrix.a, matrix.b, matrix.a, matrix.b);
+    const __m128 cd = _mm_setr_ps(matrix.c, matrix.d, matrix.c, matrix.d);
+    const __m128 ef = _mm_setr_ps(matrix.e, matrix.f, matrix.e, matrix.f);
+    for(; index + 2 <= count; index += 2) {
+        __m128 xy = _mm_loadu_ps(points + index * 2);
+        __m128 xx = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 yy = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(3, 3, 1, 1));
+        _mm_storeu_ps(output + index * 2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, ab), _mm_mul_ps(yy, cd)), ef));
+    }
+#elif defined(PYLUNASVG_USE_NEON)
+    for(; index + 4 <= count; index += 4) {
+        float32x4x2_t xy = vld2q_f32(points + index * 2);
+        float32x4x2_t result;
+        result.val[0] = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(matrix.e), xy.val[0], matrix.a), xy.val[1], matrix.c);
+        result.val[1] = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(matrix.f), xy.val[0], matrix.b), xy.val[1], matrix.d);
+        vst2q_f32(output + index * 2, result);
+    }
+#endif
+    for(; index < count; ++index) {
+        float x = points[index * 2];
+        float y = points[index * 2 + 1];
+        output[index * 2] = x * matrix.a + y * matrix.c + matrix.e;
+        output[index * 2 + 1] = x * matrix.b + y * matrix.d + matrix.f;
+    }
+}
+
+static void map_boxes(const lunasvg::Matrix& matrix, const float* boxes, float* output, Py_ssize_t count)
+{
+    for(Py_ssize_t index = 0; index < count; ++index) {
+        const float* box = boxes + index * 4;
+        float x = box[0], y = box[1], w = box[2], h = box[3];
+        float aw = matrix.a * w, ch = matrix.c * h;
+        float bw = matrix.b * w, dh = matrix.d * h;
+        float* result = output + index * 4;
+        result[0] = x * matrix.a + y * matrix.c + matrix.e + std::min(aw, 0.f) + std::min(ch, 0.f);
+        result[1] = x * matrix.b + y * matrix.d + matrix.f + std::min(bw, 0.f) + std::min(dh, 0.f);
+        result[2] = std::fabs(aw) + std::fabs(ch);
+        result[3] = std::fabs(bw) + std::fabs(dh);
+    }
+}
+
+static void map_matrices(const lunasvg::Matrix& matrix, const float* matrices, float* output, Py_ssize_t count)
+{
+    for(Py_ssize_t index = 0; index < count; ++index) {
+        const float* m = matrices + index * 6;
+        float a = m[0], b = m[1], c = m[2], d = m[3], e = m[4], f = m[5];
+        float* result = output + index * 6;
+        result[0] = a * matrix.a + b * matrix.c;
+        result[1] = a * matrix.b + b * matrix.d;
+        result[2] = c * matrix.a + d * matrix.c;
+        result[3] = c * matrix.b + d * matrix.d;
+        result[4] = e * matrix.a + f * matrix.c + matrix.e;
+        result[5] = e * matrix.b + f * matrix.d + matrix.f;
+    }
+}
+
+static bool float_buffer_get(PyObject* ob, Py_buffer* buffer, bool writable, Py_ssize_t group)
+{
+    if(PyObject_GetBuffer(ob, buffer, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) == -1)
+        return false;
+    const char* format = buffer->format ? buffer->format : "B";
+    if(*format == '@' || *format == '=' || (*format == '<' && PY_LITTLE_ENDIAN))
+        ++format;
+    if(strcmp(format, "f") != 0 || buffer->itemsize != 4) {
+        PyBuffer_Release(buffer);
+        PyErr_SetString(PyExc_TypeError, "buffer must contain float32 values");
+        return false;
+    }
+
+    if(buffer->len % (group * 4)) {
+        PyBuffer_Release(buffer);
+        PyErr_Format(PyExc_ValueError, "buffer length must be a multiple of %zd values", group);
+        return false;
+    }
+
+    return true;
+}
+
+template<typename Kernel>
+static PyObject* Matrix_map_buffer(Matrix_Object* self, PyObject* args, PyObject* kwds, const char* name, Py_ssize_t group, Kernel kernel)
+{
+    static const char* kwlist[] = { "data", "out", nullptr };
+    PyObject* data_ob;
+    PyObject* out_ob = Py_None;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", (char**)kwlist, &data_ob, &out_ob)) {
+        return nullptr;
+    }
+
+    const bool in_place = out_ob == Py_None;
+    Py_buffer data;
+    if(!float_buffer_get(data_ob, &data, in_place, group))
+        return nullptr;
+    Py_buffer out = data;
+    if(!in_place) {
+        if(!float_buffer_get(out_ob, &out, true, group)) {
+            PyBuffer_Release(&data);
+            return nullptr;
+        }
+
+        if(out.len < data.len) {
+            PyBuffer_Release(&out);
+            PyBuffer_Release(&data);
+            PyErr_Format(PyExc_ValueError, "%s output buffer is too small", name);
+            return nullptr;
+        }
+    }
+
+    lunasvg::Matrix matrix = self->matrix;
+    Py_ssize_t count = data.len / (group * 4);
+    Py_BEGIN_ALLOW_THREADS
+    kernel(matrix, (const float*)data.buf, (float*)out.buf, count);
+    Py_END_ALLOW_THREADS
+    if(!in_place)
+        PyBuffer_Release(&out);
+    PyBuffer_Release(&data);
+    PyObject* result_ob = in_place ? data_ob : out_ob;
+    Py_INCREF(result_ob);
+    return result_ob;
+}
+
+static PyObject* Matrix_map_points(Matrix_Object* self, PyObject* args, PyObject* kwds)
+{
+    return Matrix_map_buffer(self, args, kwds, "map_points", 2, map_points);
+}
+
+static PyObject* Matrix_map_boxes(Matrix_Object* self, PyObject* args, PyObject* kwds)
+{
+    return Matrix_map_buffer(self, args, kwds, "map_boxes", 4, map_boxes);
+}
+
+static PyObject* Matrix_map_matrices(Matrix_Object* self, PyObject* args, PyObject* kwds)
+{
+    return Matrix_map_buffer(self, args, kwds, "map_matrices", 6, map_matrices);
+}
+
 static PyMethodDef Matrix_methods[] = {
     {"multiply", (PyCFunction)Matrix_multiply, METH_VARARGS},
     {"translate", (PyCFunction)Matrix_translate, METH_VARARGS},
@@ -405,6 +1234,9 @@ static PyMethodDef Matrix_methods[] = {
     {"invert", (PyCFunction)Matrix_invert, METH_NOARGS},
     {"inverse", (PyCFunction)Matrix_inverse, METH_NOARGS},
     {"reset", (PyCFunction)Matrix_reset, METH_NOARGS},
+    {"map_points", (PyCFunction)Matrix_map_points, METH_VARARGS | METH_KEYWORDS},
+    {"map_boxes", (PyCFunction)Matrix_map_boxes, METH_VARARGS | METH_KEYWORDS},
+    {"map_matrices", (PyCFunction)Matrix_map_matrices, METH_VARARGS | METH_KEYWORDS},
     {nullptr}
 };
 
@@ -508,35 +1340,179 @@ static PyMemberDef Box_members[] = {
     {nullptr}
 };
 
-typedef struct {
-    PyObject_HEAD
-    PyObject* document_ob;
-    lunasvg::Element element;
-} Element_Object;
+static bool viewport_bitmap(const lunasvg::Bitmap& bitmap, const lunasvg::Box& viewport, lunasvg::Matrix& matrix, lunasvg::Bitmap& target)
+{
+    int x0 = (int)std::max(0.f, std::floor(viewport.x));
+    int y0 = (int)std::max(0.f, std::floor(viewport.y));
+    int x1 = (int)std::min((float)bitmap.width(), std::ceil(viewport.x + viewport.w));
+    int y1 = (int)std::min((float)bitmap.height(), std::ceil(viewport.y + viewport.h));
+    if(x0 >= x1 || y0 >= y1)
+        return false;
+    target = lunasvg::Bitmap(bitmap.data() + y0 * bitmap.stride() + x0 * 4, x1 - x0, y1 - y0, bitmap.stride());
+    matrix.e -= x0;
+    matrix.f -= y0;
+    return true;
+}
 
-static PyObject* Element_Create(PyObject* document_ob, lunasvg::Element element)
+static inline uint32_t interpolate_pixel(uint32_t a, uint32_t b, uint32_t weight)
 {
-    if(element.isNull())
-        Py_RETURN_NONE;
-    Element_Object* element_ob = PyObject_New(Element_Object, &Element_Type);
-    element_ob->document_ob = document_ob;
-    element_ob->element = element;
-    Py_INCREF(element_ob->document_ob);
-    return (PyObject*)element_ob;
+    uint32_t rb = ((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight) >> 8;
+    uint32_t ag = (((a >> 8) & 0xff00ff) * (256 - weight) + ((b >> 8) & 0xff00ff) * weight) >> 8;
+    return (rb & 0xff00ff) | ((ag & 0xff00ff) << 8);
 }
 
-static void Element__del__(Element_Object* self)
+static inline uint32_t byte_mul(uint32_t x, uint32_t a)
 {
-    Py_DECREF(self->document_ob);
-    Py_TYPE(self)->tp_free(self);
+    uint32_t t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+    x = ((x >> 8) & 0xff00ff) * a;
+    x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+    x &= 0xff00ff00;
+    return x | t;
 }
 
-static PyObject* Element__richcompare__(Element_Object* self, PyObject* other, int op)
+static void bitmap_draw_scaled(const lunasvg::Bitmap& source, lunasvg::Bitmap& target)
 {
-    if(Py_TYPE(self) == Py_TYPE(other)) {
-        Element_Object* element_ob = ((Element_Object*)other);
-        if(op == Py_EQ) {
-            if(self->element == element_ob->element)
+    int source_width = source.width();
+    int source_height = source.height();
+    int target_width = target.width();
+    int target_height = target.height();
+    std::vector<int> x_index(target_width);
+    std::vector<uint32_t> x_weight(target_width);
+    for(int x = 0; x < target_width; ++x) {
+        float fx = std::max(0.f, (x + 0.5f) * source_width / target_width - 0.5f);
+        x_index[x] = std::min((int)fx, source_width - 1);
+        x_weight[x] = x_index[x] < source_width - 1 ? (uint32_t)((fx - x_index[x]) * 256) : 0;
+    }
+
+    for(int y = 0; y < target_height; ++y) {
+        float fy = std::max(0.f, (y + 0.5f) * source_height / target_height - 0.5f);
+        int iy = std::min((int)fy, source_height - 1);
+        uint32_t y_weight = iy < source_height - 1 ? (uint32_t)((fy - iy) * 256) : 0;
+        const uint32_t* row0 = (const uint32_t*)(source.data() + iy * source.stride());
+        const uint32_t* row1 = (const uint32_t*)(source.data() + (iy + (y_weight ? 1 : 0)) * source.stride());
+        uint32_t* target_row = (uint32_t*)(target.data() + y * target.stride());
+        for(int x = 0; x < target_width; ++x) {
+            int ix0 = x_index[x];
+            int ix1 = ix0 + (x_weight[x] ? 1 : 0);
+            uint32_t top = interpolate_pixel(row0[ix0], row0[ix1], x_weight[x]);
+            uint32_t bottom = interpolate_pixel(row1[ix0], row1[ix1], x_weight[x]);
+            uint32_t pixel = interpolate_pixel(top, bottom, y_weight);
+            uint32_t alpha = pixel >> 24;
+            if(alpha == 255) {
+                target_row[x] = pixel;
+            } else if(alpha > 0) {
+                target_row[x] = pixel + byte_mul(target_row[x], 255 - alpha);
+            }
+        }
+    }
+}
+
+template<typename Render>
+static void render_with_quality(lunasvg::Bitmap& target, const lunasvg::Matrix& matrix, float quality, Render render)
+{
+    if(quality < 1.f) {
+        int width = std::max(1, (int)std::ceil(target.width() * quality));
+        int height = std::max(1, (int)std::ceil(target.height() * quality));
+        lunasvg::Bitmap bitmap(width, height);
+        if(!bitmap.isNull()) {
+            float sx = (float)width / target.width();
+            float sy = (float)height / target.height();
+            bitmap.clear(0x00000000);
+            render(bitmap, lunasvg::Matrix(matrix.a * sx, matrix.b * sy, matrix.c * sx, matrix.d * sy, matrix.e * sx, matrix.f * sy));
+            bitmap_draw_scaled(bitmap, target);
+            return;
+        }
+    }
+
+    render(target, matrix);
+}
+
+static bool quality_check(float quality)
+{
+    if(quality > 0.f && quality <= 1.f)
+        return true;
+    PyErr_SetString(PyExc_ValueError, "quality must be greater than 0 and at most 1");
+    return false;
+}
+
+struct DocumentEdit {
+    bool root;
+    std::string id;
+    std::string name;
+    std::string value;
+};
+
+typedef struct {
+    PyObject_HEAD
+    PyObject* source;
+    std::unique_ptr<lunasvg::Document> document;
+    std::vector<DocumentEdit> edits;
+    bool edits_dropped;
+} Document_Object;
+
+static void document_record_edit(Document_Object* document_ob, const lunasvg::Element& element, const std::string& name, const std::string& value)
+{
+    bool root = element == document_ob->document->documentElement();
+    const std::string& id = element.getAttribute("id");
+    if(root || !id.empty()) {
+        auto& edits = document_ob->edits;
+        auto it = edits.rbegin();
+        for(; it != edits.rend() && it->name != "id"; ++it) {
+            if(it->root == root && it->id == id && it->name == name) {
+                it->value = value;
+                break;
+            }
+        }
+
+        if(it == edits.rend() || it->name == "id") {
+            edits.push_back({root, id, name, value});
+        }
+    } else {
+        document_ob->edits_dropped = true;
+    }
+}
+
+static void document_replay_edits(lunasvg::Document* document, const std::vector<DocumentEdit>& edits)
+{
+    for(const auto& edit : edits) {
+        lunasvg::Element element = edit.root ? document->documentElement() : document->getElementById(edit.id);
+        if(!element.isNull()) {
+            element.setAttribute(edit.name, edit.value);
+        }
+    }
+}
+
+typedef struct {
+    PyObject_HEAD
+    PyObject* document_ob;
+    lunasvg::Element element;
+} Element_Object;
+
+static PyObject* Element_Create(PyObject* document_ob, lunasvg::Element element)
+{
+    if(element.isNull())
+        Py_RETURN_NONE;
+    Element_Object* element_ob = PyObject_New(Element_Object, &Element_Type);
+    element_ob->document_ob = document_ob;
+    element_ob->element = element;
+    Py_INCREF(element_ob->document_ob);
+    return (PyObject*)element_ob;
+}
+
+static void Element__del__(Element_Object* self)
+{
+    Py_DECREF(self->document_ob);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject* Element__richcompare__(Element_Object* self, PyObject* other, int op)
+{
+    if(Py_TYPE(self) == Py_TYPE(other)) {
+        Element_Object* element_ob = ((Element_Object*)other);
+        if(op == Py_EQ) {
+            if(self->element == element_ob->element)
                 Py_RETURN_TRUE;
             Py_RETURN_FALSE;
         }
@@ -581,27 +1557,38 @@ static PyObject* Element_set_attribute(Element_Object* self, PyObject* args)
         return nullptr;
     }
 
+    document_record_edit((Document_Object*)self->document_ob, self->element, name, value);
     Py_BEGIN_ALLOW_THREADS
     self->element.setAttribute(name, value);
     Py_END_ALLOW_THREADS
     Py_RETURN_NONE;
 }
 
-static PyObject* Element_render(Element_Object* self, PyObject* args)
+static PyObject* Element_render(Element_Object* self, PyObject* args, PyObject* kwds)
 {
+    static const char* kwlist[] = { "bitmap", "matrix", "viewport", "quality", nullptr };
     Bitmap_Object* bitmap_ob;
     Matrix_Object* matrix_ob = nullptr;
-    if(!PyArg_ParseTuple(args, "O!|O!", &Bitmap_Type, &bitmap_ob, &Matrix_Type, &matrix_ob)) {
+    Box_Object* viewport_ob = nullptr;
+    float quality = 1.f;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!|O!O!f", (char**)kwlist, &Bitmap_Type, &bitmap_ob, &Matrix_Type, &matrix_ob, &Box_Type, &viewport_ob, &quality)) {
         return nullptr;
     }
 
+    if(!quality_check(quality))
+        return nullptr;
     lunasvg::Matrix matrix;
     if(matrix_ob) {
         matrix = matrix_ob->matrix;
     }
 
+    lunasvg::Bitmap bitmap(bitmap_ob->bitmap);
+    if(viewport_ob && !viewport_bitmap(bitmap_ob->bitmap, viewport_ob->box, matrix, bitmap))
+        Py_RETURN_NONE;
     Py_BEGIN_ALLOW_THREADS
-    self->element.render(bitmap_ob->bitmap, matrix);
+    render_with_quality(bitmap, matrix, quality, [self](lunasvg::Bitmap& target, const lunasvg::Matrix& transform) {
+        self->element.render(target, transform);
+    });
     Py_END_ALLOW_THREADS
     Py_RETURN_NONE;
 }
@@ -667,7 +1654,7 @@ static PyMethodDef Element_methods[] = {
     {"has_attribute", (PyCFunction)Element_has_attribute, METH_VARARGS},
     {"get_attribute", (PyCFunction)Element_get_attribute, METH_VARARGS},
     {"set_attribute", (PyCFunction)Element_set_attribute, METH_VARARGS},
-    {"render", (PyCFunction)Element_render, METH_VARARGS},
+    {"render", (PyCFunction)Element_render, METH_VARARGS | METH_KEYWORDS},
     {"render_to_bitmap", (PyCFunction)Element_render_to_bitmap, METH_VARARGS | METH_KEYWORDS},
     {"get_local_matrix", (PyCFunction)Element_get_local_matrix, METH_NOARGS},
     {"get_global_matrix", (PyCFunction)Element_get_global_matrix, METH_NOARGS},
@@ -679,18 +1666,35 @@ static PyMethodDef Element_methods[] = {
     {nullptr}
 };
 
-typedef struct {
-    PyObject_HEAD
-    std::unique_ptr<lunasvg::Document> document;
-} Document_Object;
-
-static PyObject* Document_Create(std::unique_ptr<lunasvg::Document> document)
+static PyObject* Document_Create(PyObject* source, std::unique_ptr<lunasvg::Document> document)
 {
     Document_Object* document_ob = PyObject_New(Document_Object, &Document_Type);
     new (&document_ob->document) std::unique_ptr<lunasvg::Document>(std::move(document));
+    new (&document_ob->edits) std::vector<DocumentEdit>();
+    document_ob->edits_dropped = false;
+    document_ob->source = source;
+    Py_INCREF(document_ob->source);
     return (PyObject*)document_ob;
 }
 
+static PyObject* Document_Load(PyObject* source, const char* error_message)
+{
+    Py_buffer buffer;
+    if(PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE) == -1)
+        return nullptr;
+    std::unique_ptr<lunasvg::Document> document;
+    Py_BEGIN_ALLOW_THREADS
+    document = lunasvg::Document::loadFromData((const char*)buffer.buf, buffer.len);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&buffer);
+    if(document == nullptr) {
+        PyErr_SetString(PyExc_ValueError, error_message);
+        return nullptr;
+    }
+
+    return Document_Create(source, std::move(document));
+}
+
 static PyObject* Document__new__(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
     PyObject* file_ob;
@@ -698,40 +1702,813 @@ static PyObject* Document__new__(PyTypeObject* type, PyObject* args, PyObject* k
         return nullptr;
     }
 
-    std::unique_ptr<lunasvg::Document> document;
+    FILE* fp = fopen(PyBytes_AS_STRING(file_ob), "rb");
+    Py_DECREF(file_ob);
+    if(fp == nullptr) {
+        PyErr_SetString(PyExc_ValueError, "Failed to load document from file.");
+        return nullptr;
+    }
+
+    long length = -1;
+    if(fseek(fp, 0, SEEK_END) == 0)
+        length = ftell(fp);
+    if(length < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        PyErr_SetString(PyExc_ValueError, "Failed to load document from file.");
+        return nullptr;
+    }
+
+    PyObject* source = PyBytes_FromStringAndSize(nullptr, length);
+    if(source == nullptr) {
+        fclose(fp);
+        return nullptr;
+    }
+
+    size_t nread = 0;
     Py_BEGIN_ALLOW_THREADS
-    document = lunasvg::Document::loadFromFile(PyBytes_AS_STRING(file_ob));
+    nread = fread(PyBytes_AS_STRING(source), 1, length, fp);
+    fclose(fp);
     Py_END_ALLOW_THREADS
-    Py_DECREF(file_ob);
-    if(document == nullptr) {
+    if(nread != (size_t)length) {
+        Py_DECREF(source);
         PyErr_SetString(PyExc_ValueError, "Failed to load document from file.");
         return nullptr;
     }
 
-    return Document_Create(std::move(document));
+    PyObject* document_ob = Document_Load(source, "Failed to load document from file.");
+    Py_DECREF(source);
+    return document_ob;
 }
 
 static void Document__del__(Document_Object* self)
 {
     self->document.~unique_ptr<lunasvg::Document>();
+    self->edits.~vector<DocumentEdit>();
+    Py_XDECREF(self->source);
     Py_TYPE(self)->tp_free(self);
 }
 
-static PyObject* Document_load_from_data(PyTypeObject* type, PyObject* args)
+static inline bool svg_is_space(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline bool svg_starts_with(const char* begin, const char* end, const char* token)
+{
+    size_t length = std::strlen(token);
+    return (size_t)(end - begin) >= length && std::memcmp(begin, token, length) == 0;
+}
+
+static const char* svg_find(const char* begin, const char* end, const char* token)
+{
+    const char* it = std::search(begin, end, token, token + std::strlen(token));
+    return it == end ? end : it + std::strlen(token);
+}
+
+typedef std::map<std::string, std::string> ThemeVariables;
+
+static inline bool theme_is_name_char(char ch)
+{
+    return std::isalnum((unsigned char)ch) || ch == '-' || ch == '_' || (ch & 0x80);
+}
+
+enum class ThemeContext {
+    Attribute,
+    Text,
+    CData
+};
+
+static void theme_append(std::string& output, const std::string& value, ThemeContext context, char quote)
+{
+    if(context == ThemeContext::CData) {
+        size_t start = 0;
+        size_t index;
+        while((index = value.find("]]>", start)) != std::string::npos) {
+            output.append(value, start, index - start);
+            output.append("]]]]><![CDATA[>");
+            start = index + 3;
+        }
+
+        output.append(value, start, std::string::npos);
+        return;
+    }
+
+    for(char ch : value) {
+        if(ch == '&') {
+            output.append("&amp;");
+        } else if(ch == '<') {
+            output.append("&lt;");
+        } else if(context == ThemeContext::Attribute && ch == quote) {
+            output.append(ch == '"' ? "&quot;" : "&apos;");
+        } else {
+            output.push_back(ch);
+        }
+    }
+}
+
+static void theme_substitute(const char* begin, const char* end, const ThemeVariables& variables, ThemeContext context, char quote, std::string& output)
+{
+    static const char var_token[] = "var(";
+    const char* it = begin;
+    while(it < end) {
+        const char* match = std::search(it, end, var_token, var_token + 4);
+        if(match == end || variables.empty()) {
+            output.append(it, end - it);
+            return;
+        }
+
+        output.append(it, match - it);
+        it = match + 4;
+        if(match > begin && theme_is_name_char(match[-1])) {
+            output.append(var_token, 4);
+            continue;
+        }
+
+        const char* name = it;
+        while(name < end && svg_is_space(*name))
+            ++name;
+        const char* name_end = name;
+        while(name_end < end && theme_is_name_char(*name_end))
+            ++name_end;
+        const char* close = name_end;
+        int depth = 0;
+        while(close < end && (depth > 0 || *close != ')')) {
+            if(*close == '(')
+                ++depth;
+            else if(*close == ')')
+                --depth;
+            ++close;
+        }
+
+        if(close == end || name_end - name < 3 || name[0] != '-' || name[1] != '-') {
+            output.append(var_token, 4);
+            continue;
+        }
+
+        auto variable = variables.find(std::string(name + 2, name_end));
+        if(variable != variables.end()) {
+            theme_append(output, variable->second, context, quote);
+        } else {
+            const char* fallback = name_end;
+            while(fallback < close && svg_is_space(*fallback))
+                ++fallback;
+            if(fallback < close && *fallback == ',') {
+                ++fallback;
+                while(fallback < close && svg_is_space(*fallback))
+                    ++fallback;
+                theme_substitute(fallback, close, variables, context, quote, output);
+            } else {
+                output.append(match, close + 1 - match);
+            }
+        }
+
+        it = close + 1;
+    }
+}
+
+static void theme_append_stylesheet(std::string& output, const std::string& stylesheet, const ThemeVariables& variables)
+{
+    std::string style;
+    theme_append(style, stylesheet, ThemeContext::Text, 0);
+    output.append("<style>");
+    theme_substitute(style.data(), style.data() + style.size(), variables, ThemeContext::Text, 0, output);
+    output.append("</style>");
+}
+
+static bool theme_is_style(const char* name, const char* name_end)
+{
+    const char* local = std::find(name, name_end, ':');
+    local = local == name_end ? name : local + 1;
+    return name_end - local == 5 && std::memcmp(local, "style", 5) == 0;
+}
+
+static void theme_apply(const char* data, size_t size, const std::string& stylesheet, const ThemeVariables& variables, std::string& output)
+{
+    output.reserve(size + stylesheet.size() + 32);
+    const char* it = data;
+    const char* end = data + size;
+    std::vector<bool> element_stack;
+    bool stylesheet_inserted = false;
+    while(it < end) {
+        bool in_style = !element_stack.empty() && element_stack.back();
+        if(*it != '<') {
+            const char* text_end = std::find(it, end, '<');
+            if(in_style) {
+                theme_substitute(it, text_end, variables, ThemeContext::Text, 0, output);
+            } else {
+                output.append(it, text_end - it);
+            }
+
+            it = text_end;
+            continue;
+        }
+
+        const char* token_end;
+        if(svg_starts_with(it, end, "<!--")) {
+            token_end = svg_find(it + 4, end, "-->");
+        } else if(svg_starts_with(it, end, "<![CDATA[")) {
+            token_end = svg_find(it + 9, end, "]]>");
+            if(in_style && token_end - it >= 12 && std::memcmp(token_end - 3, "]]>", 3) == 0) {
+                output.append(it, 9);
+                theme_substitute(it + 9, token_end - 3, variables, ThemeContext::CData, 0, output);
+                output.append("]]>");
+                it = token_end;
+                continue;
+            }
+        } else if(svg_starts_with(it, end, "<?")) {
+            token_end = svg_find(it + 2, end, "?>");
+        } else if(svg_starts_with(it, end, "<!")) {
+            token_end = it + 2;
+            int depth = 0;
+            while(token_end < end && (depth > 0 || *token_end != '>')) {
+                if(*token_end == '[')
+                    ++depth;
+                else if(*token_end == ']')
+                    --depth;
+                ++token_end;
+            }
+
+            token_end = std::min(token_end + 1, end);
+        } else if(svg_starts_with(it, end, "</")) {
+            token_end = svg_find(it + 2, end, ">");
+            if(!element_stack.empty())
+                element_stack.pop_back();
+            if(element_stack.empty() && !stylesheet.empty() && !stylesheet_inserted) {
+                theme_append_stylesheet(output, stylesheet, variables);
+                stylesheet_inserted = true;
+            }
+        } else {
+            const char* name_end = it + 1;
+            while(name_end < end && !svg_is_space(*name_end) && *name_end != '/' && *name_end != '>')
+                ++name_end;
+            const char* last = it;
+            token_end = name_end;
+            while(token_end < end && *token_end != '>') {
+                if(*token_end != '"' && *token_end != '\'') {
+                    ++token_end;
+                    continue;
+                }
+
+                char quote = *token_end++;
+                const char* value_end = std::find(token_end, end, quote);
+                output.append(last, token_end - last);
+                theme_substitute(token_end, value_end, variables, ThemeContext::Attribute, quote, output);
+                last = token_end = value_end;
+                if(token_end < end) {
+                    ++token_end;
+                }
+            }
+
+            if(token_end == end) {
+                output.append(last, end - last);
+                break;
+            }
+
+            bool self_closing = token_end[-1] == '/';
+            if(self_closing && element_stack.empty() && !stylesheet.empty() && !stylesheet_inserted) {
+                stylesheet_inserted = true;
+                output.append(last, token_end - 1 - last);
+                output.append(">");
+                theme_append_stylesheet(output, stylesheet, variables);
+                output.append("</");
+                output.append(it + 1, name_end - it - 1);
+                output.append(">");
+                it = token_end + 1;
+                continue;
+            }
+
+            output.append(last, token_end + 1 - last);
+            if(!self_closing)
+                element_stack.push_back(in_style || theme_is_style(it + 1, name_end));
+            it = token_end + 1;
+            continue;
+        }
+
+        output.append(it, token_end - it);
+        it = token_end;
+    }
+}
+
+static int theme_variables_conv(PyObject* ob, ThemeVariables* variables)
 {
-    const char* data;
-    if(!PyArg_ParseTuple(args, "s", &data))
+    if(ob == Py_None)
+        return 1;
+    if(!PyDict_Check(ob)) {
+        PyErr_SetString(PyExc_TypeError, "variables must be a dict");
+        return 0;
+    }
+
+    PyObject* key_ob;
+    PyObject* value_ob;
+    Py_ssize_t pos = 0;
+    while(PyDict_Next(ob, &pos, &key_ob, &value_ob)) {
+        const char* key = PyUnicode_Check(key_ob) ? PyUnicode_AsUTF8(key_ob) : nullptr;
+        const char* value = PyUnicode_Check(value_ob) ? PyUnicode_AsUTF8(value_ob) : nullptr;
+        if(key == nullptr || value == nullptr) {
+            if(!PyErr_Occurred())
+                PyErr_SetString(PyExc_TypeError, "variables must map strings to strings");
+            return 0;
+        }
+
+        if(key[0] == '-' && key[1] == '-')
+            key += 2;
+        (*variables)[key] = value;
+    }
+
+    return 1;
+}
+
+static PyObject* Document_load_from_data(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "data", "stylesheet", "variables", nullptr };
+    PyObject* data;
+    const char* stylesheet = nullptr;
+    ThemeVariables variables;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|zO&", (char**)kwlist, &data, &stylesheet, theme_variables_conv, &variables))
         return nullptr;
-    std::unique_ptr<lunasvg::Document> document;
+    PyObject* source;
+    if(PyUnicode_Check(data)) {
+        source = PyUnicode_AsUTF8String(data);
+    } else if(PyBytes_CheckExact(data)) {
+        source = data;
+        Py_INCREF(source);
+    } else if(PyObject_CheckBuffer(data)) {
+        source = PyMemoryView_FromObject(data);
+        if(source && !PyMemoryView_GET_BUFFER(source)->readonly) {
+            Py_DECREF(source);
+            source = PyBytes_FromObject(data);
+        }
+    } else {
+        PyErr_SetString(PyExc_TypeError, "data must be a string or a bytes-like object");
+        return nullptr;
+    }
+
+    if(source == nullptr)
+        return nullptr;
+    if((stylesheet && *stylesheet) || !variables.empty()) {
+        Py_buffer buffer;
+        if(PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE) == -1) {
+            Py_DECREF(source);
+            return nullptr;
+        }
+
+        std::string output;
+        Py_BEGIN_ALLOW_THREADS
+        theme_apply((const char*)buffer.buf, buffer.len, stylesheet ? stylesheet : "", variables, output);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buffer);
+        Py_DECREF(source);
+        source = PyBytes_FromStringAndSize(output.data(), output.size());
+        if(source == nullptr) {
+            return nullptr;
+        }
+    }
+
+    PyObject* document_ob = Document_Load(source, "Failed to load document from data.");
+    Py_DECREF(source);
+    return document_ob;
+}
+
+static PyObject* Document__reduce__(Document_Object* self, PyObject* args)
+{
+    PyObject* load_ob = PyObject_GetAttrString((PyObject*)Py_TYPE(self), "load_from_data");
+    if(load_ob == nullptr)
+        return nullptr;
+    PyObject* source = PyBytes_FromObject(self->source);
+    if(source == nullptr) {
+        Py_DECREF(load_ob);
+        return nullptr;
+    }
+
+    PyObject* edits_ob = PyList_New(self->edits.size());
+    if(edits_ob == nullptr) {
+        Py_DECREF(load_ob);
+        Py_DECREF(source);
+        return nullptr;
+    }
+
+    for(size_t i = 0; i < self->edits.size(); ++i) {
+        const DocumentEdit& edit = self->edits[i];
+        PyObject* edit_ob;
+        if(edit.root) {
+            edit_ob = Py_BuildValue("(Oss)", Py_None, edit.name.data(), edit.value.data());
+        } else {
+            edit_ob = Py_BuildValue("(sss)", edit.id.data(), edit.name.data(), edit.value.data());
+        }
+
+        if(edit_ob == nullptr) {
+            Py_DECREF(load_ob);
+            Py_DECREF(source);
+            Py_DECREF(edits_ob);
+            return nullptr;
+        }
+
+        PyList_SET_ITEM(edits_ob, i, edit_ob);
+    }
+
+    return Py_BuildValue("(N(N)N)", load_ob, source, edits_ob);
+}
+
+static PyObject* Document__setstate__(Document_Object* self, PyObject* state)
+{
+    PyObject* sequence_ob = PySequence_Fast(state, "state must be a sequence of edits");
+    if(sequence_ob == nullptr)
+        return nullptr;
+    std::vector<DocumentEdit> edits;
+    for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence_ob); ++i) {
+        PyObject* id_ob;
+        const char* name;
+        const char* value;
+        if(!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence_ob, i), "Oss", &id_ob, &name, &value)) {
+            Py_DECREF(sequence_ob);
+            return nullptr;
+        }
+
+        const char* id = "";
+        if(id_ob != Py_None && (id = PyUnicode_AsUTF8(id_ob)) == nullptr) {
+            Py_DECREF(sequence_ob);
+            return nullptr;
+        }
+
+        edits.push_back({id_ob == Py_None, id, name, value});
+    }
+
+    Py_DECREF(sequence_ob);
     Py_BEGIN_ALLOW_THREADS
-    document = lunasvg::Document::loadFromData(data);
+    document_replay_edits(self->document.get(), edits);
     Py_END_ALLOW_THREADS
-    if(document == nullptr) {
-        PyErr_SetString(PyExc_ValueError, "Failed to load document from data.");
+    self->edits.insert(self->edits.end(), edits.begin(), edits.end());
+    Py_RETURN_NONE;
+}
+
+static PyObject* Document_clone(Document_Object* self, PyObject* args)
+{
+    if(self->edits_dropped && PyErr_WarnEx(PyExc_RuntimeWarning, "attribute changes to elements without an id are not copied to the clone", 1) == -1)
+        return nullptr;
+    Document_Object* clone_ob = (Document_Object*)Document_Load(self->source, "Failed to load document from data.");
+    if(clone_ob == nullptr)
+        return nullptr;
+    clone_ob->edits = self->edits;
+    Py_BEGIN_ALLOW_THREADS
+    document_replay_edits(clone_ob->document.get(), clone_ob->edits);
+    Py_END_ALLOW_THREADS
+    return (PyObject*)clone_ob;
+}
+
+static void string_write_func(void* closure, void* data, int length)
+{
+    ((std::string*)closure)->append((const char*)data, length);
+}
+
+typedef std::vector<std::pair<std::string, std::string>> SvgAttributeList;
+
+struct SvgOverrides {
+    SvgAttributeList root;
+    std::map<std::string, SvgAttributeList> elements;
+};
+
+static void svg_attribute_list_set(SvgAttributeList& attributes, const std::string& name, const std::string& value)
+{
+    for(auto& attribute : attributes) {
+        if(attribute.first == name) {
+            attribute.second = value;
+            return;
+        }
+    }
+
+    attributes.emplace_back(name, value);
+}
+
+static void svg_overrides_resolve(const std::vector<DocumentEdit>& edits, SvgOverrides& overrides)
+{
+    std::map<std::string, std::string> aliases;
+    for(const auto& edit : edits) {
+        if(edit.root) {
+            svg_attribute_list_set(overrides.root, edit.name, edit.value);
+            continue;
+        }
+
+        auto it = aliases.find(edit.id);
+        std::string source_id = it == aliases.end() ? edit.id : it->second;
+        if(source_id.empty())
+            continue;
+        svg_attribute_list_set(overrides.elements[source_id], edit.name, edit.value);
+        if(edit.name == "id") {
+            aliases[edit.id] = std::string();
+            aliases[edit.value] = source_id;
+        }
+    }
+}
+
+struct SvgWriter {
+    void (*write_func)(void*, void*, int);
+    void* closure;
+    std::string buffer;
+
+    void write(const char* data, size_t length)
+    {
+        buffer.append(data, length);
+        if(buffer.size() >= 65536) {
+            flush();
+        }
+    }
+
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    void write_escaped(const std::string& value, char quote)
+    {
+        for(char ch : value) {
+            switch(ch) {
+            case '&':
+                write("&amp;", 5);
+                break;
+            case '<':
+                write("&lt;", 4);
+                break;
+            default:
+                if(ch == quote) {
+                    write(ch == '"' ? "&quot;" : "&apos;", 6);
+                } else {
+                    write(&ch, 1);
+                }
+
+                break;
+            }
+        }
+    }
+
+    void flush()
+    {
+        if(!buffer.empty()) {
+            write_func(closure, &buffer[0], buffer.size());
+            buffer.clear();
+        }
+    }
+};
+
+struct SvgAttributeToken {
+    const char* begin;
+    const char* name_end;
+    const char* value_begin;
+    const char* value_end;
+};
+
+static bool svg_preserves_space(const char* name, const char* name_end)
+{
+    const char* local = std::find(name, name_end, ':');
+    local = local == name_end ? name : local + 1;
+    std::string local_name(local, name_end);
+    return local_name == "text" || local_name == "tspan" || local_name == "textPath";
+}
+
+static void svg_write_start_tag(SvgWriter& writer, const char* begin, const char* end, const SvgOverrides& overrides, bool root, bool minify, bool& self_closing, bool& preserve)
+{
+    const char* name = begin + 1;
+    const char* it = name;
+    while(it < end && !svg_is_space(*it) && *it != '/' && *it != '>')
+        ++it;
+    const char* name_end = it;
+
+    std::vector<SvgAttributeToken> attributes;
+    while(true) {
+        while(it < end && svg_is_space(*it))
+            ++it;
+        if(it >= end || *it == '/' || *it == '>')
+            break;
+        SvgAttributeToken attribute;
+        attribute.begin = it;
+        while(it < end && !svg_is_space(*it) && *it != '=' && *it != '/' && *it != '>')
+            ++it;
+        attribute.name_end = it;
+        while(it < end && svg_is_space(*it))
+            ++it;
+        if(it >= end || *it != '=')
+            break;
+        ++it;
+        while(it < end && svg_is_space(*it))
+            ++it;
+        if(it >= end || (*it != '"' && *it != '\''))
+            break;
+        char quote = *it++;
+        attribute.value_begin = it;
+        while(it < end && *it != quote)
+            ++it;
+        attribute.value_end = it;
+        if(it < end)
+            ++it;
+        attributes.push_back(attribute);
+    }
+
+    const char* tail = attributes.empty() ? name_end : std::min(attributes.back().value_end + 1, end);
+    self_closing = std::find(tail, end, '/') != end;
+    preserve = svg_preserves_space(name, name_end);
+    const SvgAttributeList* element_overrides = nullptr;
+    if(root) {
+        if(!overrides.root.empty())
+            element_overrides = &overrides.root;
+    } else if(!overrides.elements.empty()) {
+        for(const auto& attribute : attributes) {
+            if(attribute.name_end - attribute.begin == 2 && std::memcmp(attribute.begin, "id", 2) == 0) {
+                auto match = overrides.elements.find(std::string(attribute.value_begin, attribute.value_end));
+                if(match != overrides.elements.end())
+                    element_overrides = &match->second;
+                break;
+            }
+        }
+    }
+
+    if(element_overrides == nullptr && !minify) {
+        writer.write(begin, end - begin);
+        return;
+    }
+
+    std::vector<bool> applied(element_overrides ? element_overrides->size() : 0, false);
+    writer.write(begin, name_end - begin);
+    const char* last = name_end;
+    for(const auto& attribute : attributes) {
+        char quote = attribute.value_begin[-1];
+        if(minify) {
+            writer.write(" ", 1);
+            writer.write(attribute.begin, attribute.name_end - attribute.begin);
+            writer.write("=", 1);
+            writer.write(&quote, 1);
+        } else {
+            writer.write(last, attribute.value_begin - last);
+        }
+
+        const std::string* value = nullptr;
+        if(element_overrides) {
+            for(size_t i = 0; i < element_overrides->size(); ++i) {
+                const auto& override = (*element_overrides)[i];
+                if(override.first.compare(0, std::string::npos, attribute.begin, attribute.name_end - attribute.begin) == 0) {
+                    value = &override.second;
+                    applied[i] = true;
+                    break;
+                }
+            }
+        }
+
+        if(value) {
+            writer.write_escaped(*value, quote);
+        } else {
+            writer.write(attribute.value_begin, attribute.value_end - attribute.value_begin);
+        }
+
+        writer.write(&quote, 1);
+        last = std::min(attribute.value_end + 1, end);
+    }
+
+    for(size_t i = 0; i < applied.size(); ++i) {
+        if(!applied[i]) {
+            const auto& override = (*element_overrides)[i];
+            writer.write(" ", 1);
+            writer.write(override.first);
+            writer.write("=\"", 2);
+            writer.write_escaped(override.second, '"');
+            writer.write("\"", 1);
+        }
+    }
+
+    if(minify) {
+        writer.write(self_closing ? "/>" : ">", self_closing ? 2 : 1);
+    } else {
+        writer.write(last, end - last);
+    }
+}
+
+static void svg_serialize(const char* data, size_t size, const std::vector<DocumentEdit>& edits, bool minify, SvgWriter& writer)
+{
+    SvgOverrides overrides;
+    svg_overrides_resolve(edits, overrides);
+
+    const char* it = data;
+    const char* end = data + size;
+    bool seen_root = false;
+    std::vector<bool> preserve_stack;
+    while(it < end) {
+        if(*it != '<') {
+            const char* text_end = std::find(it, end, '<');
+            bool preserve = !preserve_stack.empty() && preserve_stack.back();
+            if(!minify || preserve || !std::all_of(it, text_end, svg_is_space))
+                writer.write(it, text_end - it);
+            it = text_end;
+            continue;
+        }
+
+        const char* token_end;
+        if(svg_starts_with(it, end, "<!--")) {
+            token_end = svg_find(it + 4, end, "-->");
+            if(!minify)
+                writer.write(it, token_end - it);
+            it = token_end;
+            continue;
+        }
+
+        if(svg_starts_with(it, end, "<![CDATA[")) {
+            token_end = svg_find(it + 9, end, "]]>");
+        } else if(svg_starts_with(it, end, "<?")) {
+            token_end = svg_find(it + 2, end, "?>");
+        } else if(svg_starts_with(it, end, "<!")) {
+            token_end = it + 2;
+            int depth = 0;
+            while(token_end < end && (depth > 0 || *token_end != '>')) {
+                if(*token_end == '[')
+                    ++depth;
+                else if(*token_end == ']')
+                    --depth;
+                ++token_end;
+            }
+
+            token_end = std::min(token_end + 1, end);
+        } else if(svg_starts_with(it, end, "</")) {
+            token_end = svg_find(it + 2, end, ">");
+            if(!preserve_stack.empty())
+                preserve_stack.pop_back();
+            if(minify && token_end[-1] == '>') {
+                const char* name_end = it + 2;
+                while(name_end < token_end && !svg_is_space(*name_end) && *name_end != '>')
+                    ++name_end;
+                writer.write(it, name_end - it);
+                writer.write(">", 1);
+                it = token_end;
+                continue;
+            }
+        } else {
+            token_end = it + 1;
+            char quote = 0;
+            while(token_end < end && (quote || *token_end != '>')) {
+                if(quote && *token_end == quote)
+                    quote = 0;
+                else if(!quote && (*token_end == '"' || *token_end == '\''))
+                    quote = *token_end;
+                ++token_end;
+            }
+
+            if(token_end == end) {
+                writer.write(it, end - it);
+                break;
+            }
+
+            token_end += 1;
+
+            bool root = !seen_root;
+            seen_root = true;
+            bool self_closing = false;
+            bool preserve = false;
+            svg_write_start_tag(writer, it, token_end, overrides, root, minify, self_closing, preserve);
+            if(!self_closing)
+                preserve_stack.push_back(preserve || (!preserve_stack.empty() && preserve_stack.back()));
+            it = token_end;
+            continue;
+        }
+
+        writer.write(it, token_end - it);
+        it = token_end;
+    }
+
+    writer.flush();
+}
+
+static PyObject* Document_to_svg(Document_Object* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "stream", "minify", nullptr };
+    PyObject* stream_ob = Py_None;
+    int minify = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|Op", (char**)kwlist, &stream_ob, &minify)) {
+        return nullptr;
+    }
+
+    Py_buffer source;
+    if(PyObject_GetBuffer(self->source, &source, PyBUF_SIMPLE) == -1) {
+        return nullptr;
+    }
+
+    std::vector<DocumentEdit> edits(self->edits);
+    if(stream_ob == Py_None) {
+        std::string output;
+        Py_BEGIN_ALLOW_THREADS
+        SvgWriter writer = {string_write_func, &output};
+        svg_serialize((const char*)source.buf, source.len, edits, minify, writer);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&source);
+        return PyBytes_FromStringAndSize(output.data(), output.size());
+    }
+
+    StreamClosure stream = {nullptr, false, nullptr, nullptr, nullptr};
+    if(!stream_write_conv(stream_ob, &stream.write_ob)) {
+        PyBuffer_Release(&source);
         return nullptr;
     }
 
-    return Document_Create(std::move(document));
+    Py_BEGIN_ALLOW_THREADS
+    SvgWriter writer = {stream_closure_write_func, &stream};
+    svg_serialize((const char*)source.buf, source.len, edits, minify, writer);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(stream.write_ob);
+    PyBuffer_Release(&source);
+    if(stream_closure_restore(&stream))
+        return nullptr;
+    Py_RETURN_NONE;
 }
 
 static PyObject* Document_width(Document_Object* self, PyObject* args)
@@ -757,38 +2534,87 @@ static PyObject* Document_update_layout(Document_Object* self, PyObject* args)
     Py_RETURN_NONE;
 }
 
-static PyObject* Document_render(Document_Object* self, PyObject* args)
+static PyObject* Document_render(Document_Object* self, PyObject* args, PyObject* kwds)
 {
+    static const char* kwlist[] = { "bitmap", "matrix", "viewport", "quality", nullptr };
     Bitmap_Object* bitmap_ob;
     Matrix_Object* matrix_ob = nullptr;
-    if(!PyArg_ParseTuple(args, "O!|O!", &Bitmap_Type, &bitmap_ob, &Matrix_Type, &matrix_ob)) {
+    Box_Object* viewport_ob = nullptr;
+    float quality = 1.f;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!|O!O!f", (char**)kwlist, &Bitmap_Type, &bitmap_ob, &Matrix_Type, &matrix_ob, &Box_Type, &viewport_ob, &quality)) {
         return nullptr;
     }
 
+    if(!quality_check(quality))
+        return nullptr;
     lunasvg::Matrix matrix;
     if(matrix_ob) {
         matrix = matrix_ob->matrix;
     }
 
+    lunasvg::Bitmap bitmap(bitmap_ob->bitmap);
+    if(viewport_ob && !viewport_bitmap(bitmap_ob->bitmap, viewport_ob->box, matrix, bitmap))
+        Py_RETURN_NONE;
     Py_BEGIN_ALLOW_THREADS
-    self->document->render(bitmap_ob->bitmap, matrix);
+    render_with_quality(bitmap, matrix, quality, [self](lunasvg::Bitmap& target, const lunasvg::Matrix& transform) {
+        self->document->render(target, transform);
+    });
     Py_END_ALLOW_THREADS
     Py_RETURN_NONE;
 }
 
+static bool document_size(const lunasvg::Document* document, int& width, int& height, lunasvg::Matrix& matrix)
+{
+    float intrinsic_width = document->width();
+    float intrinsic_height = document->height();
+    if(intrinsic_width == 0.f || intrinsic_height == 0.f)
+        return false;
+    if(width <= 0 && height <= 0) {
+        width = (int)std::ceil(intrinsic_width);
+        height = (int)std::ceil(intrinsic_height);
+    } else if(height <= 0) {
+        height = (int)std::ceil(width * intrinsic_height / intrinsic_width);
+    } else if(width <= 0) {
+        width = (int)std::ceil(height * intrinsic_width / intrinsic_height);
+    }
+
+    matrix = lunasvg::Matrix(width / intrinsic_width, 0, 0, height / intrinsic_height, 0, 0);
+    return true;
+}
+
 static PyObject* Document_render_to_bitmap(Document_Object* self, PyObject* args, PyObject* kwds)
 {
-    static const char* kwlist[] = { "width", "height", "background_color", nullptr };
+    static const char* kwlist[] = { "width", "height", "background_color", "quality", nullptr };
     int width = -1, height = -1;
     unsigned int background_color = 0;
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iiI", (char**)kwlist, &width, &height, &background_color)) {
+    float quality = 1.f;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iiIf", (char**)kwlist, &width, &height, &background_color, &quality)) {
         return nullptr;
     }
 
+    if(!quality_check(quality))
+        return nullptr;
     lunasvg::Bitmap bitmap;
-    Py_BEGIN_ALLOW_THREADS
-    bitmap = self->document->renderToBitmap(width, height, background_color);
-    Py_END_ALLOW_THREADS
+    if(quality == 1.f) {
+        Py_BEGIN_ALLOW_THREADS
+        bitmap = self->document->renderToBitmap(width, height, background_color);
+        Py_END_ALLOW_THREADS
+    } else {
+        lunasvg::Matrix matrix;
+        if(document_size(self->document.get(), width, height, matrix)) {
+            Py_BEGIN_ALLOW_THREADS
+            bitmap = lunasvg::Bitmap(width, height);
+            if(!bitmap.isNull()) {
+                bitmap.clear(background_color);
+                render_with_quality(bitmap, matrix, quality, [self](lunasvg::Bitmap& target, const lunasvg::Matrix& transform) {
+                    self->document->render(target, transform);
+                });
+            }
+
+            Py_END_ALLOW_THREADS
+        }
+    }
+
     if(bitmap.isNull()) {
         PyErr_SetString(PyExc_ValueError, "invalid document size");
         return nullptr;
@@ -797,6 +2623,323 @@ static PyObject* Document_render_to_bitmap(Document_Object* self, PyObject* args
     return Bitmap_Create(nullptr, std::move(bitmap));
 }
 
+struct FrameEdit {
+    lunasvg::Element element;
+    std::string name;
+    std::string value;
+};
+
+static bool frame_edits_parse(Document_Object* self, PyObject* keyframe_ob, std::vector<FrameEdit>& edits)
+{
+    if(!PyDict_Check(keyframe_ob)) {
+        PyErr_SetString(PyExc_TypeError, "keyframes must be dictionaries mapping element ids to attributes");
+        return false;
+    }
+
+    Py_ssize_t position = 0;
+    PyObject *id_ob, *attributes_ob;
+    while(PyDict_Next(keyframe_ob, &position, &id_ob, &attributes_ob)) {
+        const char* id = PyUnicode_AsUTF8(id_ob);
+        if(id == nullptr)
+            return false;
+        if(!PyDict_Check(attributes_ob)) {
+            PyErr_SetString(PyExc_TypeError, "keyframe attributes must be dictionaries mapping names to values");
+            return false;
+        }
+
+        lunasvg::Element element = self->document->getElementById(id);
+        if(element.isNull()) {
+            PyErr_Format(PyExc_ValueError, "no element with id '%s'", id);
+            return false;
+        }
+
+        Py_ssize_t attribute_position = 0;
+        PyObject *name_ob, *value_ob;
+        while(PyDict_Next(attributes_ob, &attribute_position, &name_ob, &value_ob)) {
+            const char* name = PyUnicode_AsUTF8(name_ob);
+            if(name == nullptr)
+                return false;
+            const char* value = PyUnicode_AsUTF8(value_ob);
+            if(value == nullptr)
+                return false;
+            edits.push_back({element, name, value});
+        }
+    }
+
+    return true;
+}
+
+static void bitmap_copy_pixels(const lunasvg::Bitmap& bitmap, std::string& output)
+{
+    size_t row_length = bitmap.width() * 4;
+    output.resize(row_length * bitmap.height());
+    for(int y = 0; y < bitmap.height(); ++y) {
+        memcpy(&output[y * row_length], bitmap.data() + y * bitmap.stride(), row_length);
+    }
+}
+
+static uint32_t png_crc32(const char* data, size_t length, uint32_t crc = 0xFFFFFFFF)
+{
+    static const struct CrcTable {
+        uint32_t values[256];
+        CrcTable()
+        {
+            for(uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for(int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                values[n] = c;
+            }
+        }
+    } table;
+
+    for(size_t i = 0; i < length; ++i)
+        crc = table.values[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void png_append_uint32(std::string& output, uint32_t value)
+{
+    char bytes[4] = { (char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value };
+    output.append(bytes, 4);
+}
+
+static uint32_t png_read_uint32(const char* data)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static void png_append_chunk(std::string& output, const char* type, const std::string& data)
+{
+    png_append_uint32(output, data.size());
+    size_t start = output.size();
+    output.append(type, 4);
+    output.append(data);
+    png_append_uint32(output, png_crc32(&output[start], output.size() - start) ^ 0xFFFFFFFF);
+}
+
+struct ApngFrameInfo {
+    uint32_t num_frames;
+    uint32_t loops;
+    uint16_t delay_num;
+    uint16_t delay_den;
+};
+
+static bool apng_append_frame(std::string& output, const std::string& png, uint32_t index, const ApngFrameInfo& info, uint32_t& sequence)
+{
+    static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1A', '\n' };
+    if(png.size() < 8 || std::memcmp(png.data(), signature, 8) != 0)
+        return false;
+    uint32_t width = 0, height = 0;
+    size_t position = 8;
+    bool first_data = true;
+    while(position + 12 <= png.size()) {
+        uint32_t length = png_read_uint32(&png[position]);
+        if(length > png.size() - position - 12)
+            return false;
+        const char* type = &png[position + 4];
+        const char* data = &png[position + 8];
+        if(std::memcmp(type, "IHDR", 4) == 0 && length >= 8) {
+            width = png_read_uint32(data);
+            height = png_read_uint32(data + 4);
+            if(index == 0) {
+                output.append(signature, 8);
+                output.append(&png[position], length + 12);
+                std::string control;
+                png_append_uint32(control, info.num_frames);
+                png_append_uint32(control, info.loops);
+                png_append_chunk(output, "acTL", control);
+            }
+        } else if(std::memcmp(type, "IDAT", 4) == 0) {
+            if(first_data) {
+                std::string control;
+                png_append_uint32(control, sequence++);
+                png_append_uint32(control, width);
+                png_append_uint32(control, height);
+                png_append_uint32(control, 0);
+                png_append_uint32(control, 0);
+                control.push_back((char)(info.delay_num >> 8));
+                control.push_back((char)info.delay_num);
+                control.push_back((char)(info.delay_den >> 8));
+                control.push_back((char)info.delay_den);
+                control.push_back(0);
+                control.push_back(0);
+                png_append_chunk(output, "fcTL", control);
+                first_data = false;
+            }
+
+            if(index == 0) {
+                output.append(&png[position], length + 12);
+            } else {
+                std::string frame_data;
+                png_append_uint32(frame_data, sequence++);
+                frame_data.append(data, length);
+                png_append_chunk(output, "fdAT", frame_data);
+            }
+        } else if(std::memcmp(type, "IEND", 4) == 0) {
+            if(index + 1 == info.num_frames)
+                output.append(&png[position], length + 12);
+            return !first_data;
+        } else if(index == 0 && first_data && !(type[0] & 0x20)) {
+            output.append(&png[position], length + 12);
+        }
+
+        position += length + 12;
+    }
+
+    return false;
+}
+
+static PyObject* Document_render_frames(Document_Object* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "keyframes", "width", "height", "background_color", "format", "stream", "delay", "loops", nullptr };
+    PyObject* keyframes_ob;
+    int width = -1, height = -1;
+    unsigned int background_color = 0;
+    const char* format = "png";
+    PyObject* stream_ob = Py_None;
+    double delay = 0.1;
+    unsigned int loops = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiIsOdI", (char**)kwlist, &keyframes_ob, &width, &height, &background_color, &format, &stream_ob, &delay, &loops)) {
+        return nullptr;
+    }
+
+    bool raw = false;
+    bool apng = false;
+    if(strcmp(format, "raw") == 0) {
+        raw = true;
+    } else if(strcmp(format, "apng") == 0) {
+        apng = true;
+    } else if(strcmp(format, "png") != 0) {
+        PyErr_SetString(PyExc_ValueError, "format must be 'png', 'apng' or 'raw'");
+        return nullptr;
+    }
+
+    if(delay < 0.0 || delay > 65.535) {
+        PyErr_SetString(PyExc_ValueError, "delay must be between 0 and 65.535 seconds");
+        return nullptr;
+    }
+
+    PyObject* sequence_ob = PySequence_Fast(keyframes_ob, "keyframes must be a sequence");
+    if(sequence_ob == nullptr)
+        return nullptr;
+    Py_ssize_t num_frames = PySequence_Fast_GET_SIZE(sequence_ob);
+    std::vector<std::vector<FrameEdit>> frame_edits(num_frames);
+    for(Py_ssize_t i = 0; i < num_frames; ++i) {
+        if(!frame_edits_parse(self, PySequence_Fast_GET_ITEM(sequence_ob, i), frame_edits[i])) {
+            Py_DECREF(sequence_ob);
+            return nullptr;
+        }
+    }
+
+    Py_DECREF(sequence_ob);
+    if(apng && num_frames == 0) {
+        PyErr_SetString(PyExc_ValueError, "an APNG needs at least one keyframe");
+        return nullptr;
+    }
+
+    lunasvg::Matrix matrix;
+    if(!document_size(self->document.get(), width, height, matrix)) {
+        PyErr_SetString(PyExc_ValueError, "invalid document size");
+        return nullptr;
+    }
+
+    lunasvg::Bitmap bitmaps[2] = { lunasvg::Bitmap(width, height), lunasvg::Bitmap(width, height) };
+    if(bitmaps[0].isNull() || bitmaps[1].isNull()) {
+        PyErr_SetString(PyExc_MemoryError, "out of memory");
+        return nullptr;
+    }
+
+    StreamClosure stream = {nullptr, false, nullptr, nullptr, nullptr};
+    if(stream_ob != Py_None && !stream_write_conv(stream_ob, &stream.write_ob)) {
+        return nullptr;
+    }
+
+    bool streaming = stream.write_ob != nullptr;
+    bool keep_frames = !streaming && !apng;
+    std::vector<std::string> frames(keep_frames ? num_frames : 2);
+    std::string apng_output;
+    ApngFrameInfo apng_info = { (uint32_t)num_frames, loops, (uint16_t)std::lround(delay * 1000), 1000 };
+    uint32_t apng_sequence = 0;
+    bool encode_failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    std::thread encoder;
+    for(Py_ssize_t i = 0; i < num_frames; ++i) {
+        Py_BLOCK_THREADS
+        for(auto& edit : frame_edits[i]) {
+            document_record_edit(self, edit.element, edit.name, edit.value);
+            edit.element.setAttribute(edit.name, edit.value);
+        }
+
+        Py_UNBLOCK_THREADS
+
+        lunasvg::Bitmap* bitmap = &bitmaps[i % 2];
+        bitmap->clear(background_color);
+        self->document->render(*bitmap, matrix);
+        if(encoder.joinable())
+            encoder.join();
+        if(stream.failed || encode_failed)
+            break;
+        std::string* frame = &frames[keep_frames ? i : i % 2];
+        encoder = std::thread([&, bitmap, frame, i]() {
+            frame->clear();
+            if(raw) {
+                bitmap_copy_pixels(*bitmap, *frame);
+            } else {
+                bitmap->writeToPng(string_write_func, frame);
+            }
+
+            const std::string* output = frame;
+            if(apng) {
+                std::string packet;
+                if(!apng_append_frame(streaming ? packet : apng_output, *frame, i, apng_info, apng_sequence)) {
+                    encode_failed = true;
+                    return;
+                }
+
+                if(!streaming)
+                    return;
+                frame->swap(packet);
+            }
+
+            if(streaming) {
+                stream_closure_write_func(&stream, (void*)output->data(), output->size());
+            }
+        });
+    }
+
+    if(encoder.joinable())
+        encoder.join();
+    Py_END_ALLOW_THREADS
+    Py_XDECREF(stream.write_ob);
+    if(stream_closure_restore(&stream))
+        return nullptr;
+    if(encode_failed) {
+        PyErr_SetString(PyExc_ValueError, "Failed to encode APNG frame.");
+        return nullptr;
+    }
+
+    if(streaming)
+        Py_RETURN_NONE;
+    if(apng)
+        return PyBytes_FromStringAndSize(apng_output.data(), apng_output.size());
+    PyObject* frames_ob = PyList_New(num_frames);
+    if(frames_ob == nullptr)
+        return nullptr;
+    for(Py_ssize_t i = 0; i < num_frames; ++i) {
+        PyObject* frame_ob = PyBytes_FromStringAndSize(frames[i].data(), frames[i].size());
+        if(frame_ob == nullptr) {
+            Py_DECREF(frames_ob);
+            return nullptr;
+        }
+
+        PyList_SET_ITEM(frames_ob, i, frame_ob);
+    }
+
+    return frames_ob;
+}
+
 static PyObject* Document_get_element_by_id(Document_Object* self, PyObject* args)
 {
     const char* id;
@@ -817,18 +2960,95 @@ static PyObject* Document_document_element(Document_Object* self, PyObject* args
 }
 
 static PyMethodDef Document_methods[] = {
-    {"load_from_data", (PyCFunction)Document_load_from_data, METH_VARARGS | METH_CLASS},
+    {"load_from_data", (PyCFunction)Document_load_from_data, METH_VARARGS | METH_KEYWORDS | METH_CLASS},
     {"width", (PyCFunction)Document_width, METH_NOARGS},
     {"height", (PyCFunction)Document_height, METH_NOARGS},
     {"bounding_box", (PyCFunction)Document_bounding_box, METH_NOARGS},
     {"update_layout", (PyCFunction)Document_update_layout, METH_NOARGS},
-    {"render", (PyCFunction)Document_render, METH_VARARGS},
+    {"render", (PyCFunction)Document_render, METH_VARARGS | METH_KEYWORDS},
     {"render_to_bitmap", (PyCFunction)Document_render_to_bitmap, METH_VARARGS | METH_KEYWORDS},
+    {"render_frames", (PyCFunction)Document_render_frames, METH_VARARGS | METH_KEYWORDS},
     {"get_element_by_id", (PyCFunction)Document_get_element_by_id, METH_VARARGS},
     {"document_element", (PyCFunction)Document_document_element, METH_NOARGS},
+    {"clone", (PyCFunction)Document_clone, METH_NOARGS},
+    {"to_svg", (PyCFunction)Document_to_svg, METH_VARARGS | METH_KEYWORDS},
+    {"__reduce__", (PyCFunction)Document__reduce__, METH_NOARGS},
+    {"__setstate__", (PyCFunction)Document__setstate__, METH_O},
     {nullptr}
 };
 
+static MemoryMapping* memory_mapping_open_file(const char* filename)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if(handle == nullptr)
+        return nullptr;
+    void* data = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if(data == nullptr) {
+        CloseHandle(handle);
+        return nullptr;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+        return nullptr;
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return nullptr;
+    }
+#endif
+
+    MemoryMapping* mapping = (MemoryMapping*)PyMem_RawMalloc(sizeof(MemoryMapping));
+    if(mapping == nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(handle);
+#else
+        munmap(data, size);
+#endif
+        return nullptr;
+    }
+
+    mapping->data = data;
+#ifdef _WIN32
+    mapping->size = (size_t)size.QuadPart;
+    mapping->handle = handle;
+#else
+    mapping->size = size;
+#endif
+    return mapping;
+}
+
+static PyObject* font_faces_list = nullptr;
+
+static int font_faces_register(const char* family, bool bold, bool italic, PyObject* source_ob)
+{
+    PyObject* face_ob = Py_BuildValue("(sOOO)", family, bold ? Py_True : Py_False, italic ? Py_True : Py_False, source_ob);
+    if(face_ob == nullptr)
+        return -1;
+    int result = PyList_Append(font_faces_list, face_ob);
+    Py_DECREF(face_ob);
+    return result;
+}
+
 static PyObject* module_add_font_face_from_file(PyObject* self, PyObject* args)
 {
     const char* family;
@@ -844,14 +3064,25 @@ static PyObject* module_add_font_face_from_file(PyObject* self, PyObject* args)
 
     bool success = false;
     Py_BEGIN_ALLOW_THREADS
-    success = lunasvg_add_font_face_from_file(family, bold, italic, PyBytes_AS_STRING(file_ob));
+    MemoryMapping* mapping = memory_mapping_open_file(PyBytes_AS_STRING(file_ob));
+    if(mapping) {
+        success = lunasvg_add_font_face_from_data(family, bold, italic, mapping->data, mapping->size, memory_mapping_free, mapping);
+    }
     Py_END_ALLOW_THREADS
-    Py_DECREF(file_ob);
     if(!success) {
+        Py_DECREF(file_ob);
         PyErr_SetString(PyExc_ValueError, "Failed to add font face from file.");
         return nullptr;
     }
 
+    PyObject* source_ob = PyUnicode_DecodeFSDefault(PyBytes_AS_STRING(file_ob));
+    Py_DECREF(file_ob);
+    if(source_ob == nullptr)
+        return nullptr;
+    int result = font_faces_register(family, bold, italic, source_ob);
+    Py_DECREF(source_ob);
+    if(result == -1)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
@@ -885,12 +3116,428 @@ static PyObject* module_add_font_face_from_data(PyObject* self, PyObject* args)
         return nullptr;
     }
 
+    if(font_faces_register(family, bold, italic, Py_None) == -1)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
+static uint16_t read_uint16(const uint8_t* data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static uint32_t read_uint32(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static void append_utf8(std::string& output, uint32_t codepoint)
+{
+    if(codepoint < 0x80) {
+        output += (char)codepoint;
+    } else if(codepoint < 0x800) {
+        output += (char)(0xC0 | (codepoint >> 6));
+        output += (char)(0x80 | (codepoint & 0x3F));
+    } else if(codepoint < 0x10000) {
+        output += (char)(0xE0 | (codepoint >> 12));
+        output += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        output += (char)(0x80 | (codepoint & 0x3F));
+    } else {
+        output += (char)(0xF0 | (codepoint >> 18));
+        output += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        output += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        output += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
+
+static std::string font_face_family(const uint8_t* table, size_t length)
+{
+    std::string family;
+    if(length < 6)
+        return family;
+    size_t count = read_uint16(table + 2);
+    size_t string_offset = read_uint16(table + 4);
+    if(6 + count * 12 > length)
+        return family;
+    int best_score = 0;
+    for(size_t i = 0; i < count; ++i) {
+        const uint8_t* record = table + 6 + i * 12;
+        uint16_t platform_id = read_uint16(record);
+        uint16_t encoding_id = read_uint16(record + 2);
+        uint16_t language_id = read_uint16(record + 4);
+        uint16_t name_id = read_uint16(record + 6);
+        size_t string_length = read_uint16(record + 8);
+        size_t offset = string_offset + read_uint16(record + 10);
+        if(name_id != 1 || offset + string_length > length)
+            continue;
+        int score = 0;
+        if(platform_id == 3 && (encoding_id == 0 || encoding_id == 1 || encoding_id == 10)) {
+            score = language_id == 0x409 ? 4 : 3;
+        } else if(platform_id == 0) {
+            score = 2;
+        } else if(platform_id == 1 && encoding_id == 0) {
+            score = 1;
+        }
+
+        if(score <= best_score)
+            continue;
+        const uint8_t* data = table + offset;
+        std::string name;
+        if(platform_id == 1) {
+            for(size_t j = 0; j < string_length; ++j) {
+                append_utf8(name, data[j]);
+            }
+        } else {
+            for(size_t j = 0; j + 1 < string_length; j += 2) {
+                uint32_t codepoint = read_uint16(data + j);
+                if(codepoint >= 0xD800 && codepoint < 0xDC00 && j + 3 < string_length) {
+                    uint32_t low = read_uint16(data + j + 2);
+                    if(low >= 0xDC00 && low < 0xE000) {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        j += 2;
+                    }
+                }
+
+                append_utf8(name, codepoint);
+            }
+        }
+
+        if(!name.empty()) {
+            family = std::move(name);
+            best_score = score;
+        }
+    }
+
+    return family;
+}
+
+static bool font_face_parse(const uint8_t* data, size_t size, std::string& family, bool& bold, bool& italic)
+{
+    if(size < 12)
+        return false;
+    size_t offset = 0;
+    if(read_uint32(data) == 0x74746366) {
+        if(size < 16 || read_uint32(data + 8) == 0)
+            return false;
+        offset = read_uint32(data + 12);
+        if(offset > size - 12) {
+            return false;
+        }
+    }
+
+    size_t num_tables = read_uint16(data + offset + 4);
+    if(offset + 12 + num_tables * 16 > size)
+        return false;
+    const uint8_t* name_table = nullptr;
+    const uint8_t* os2_table = nullptr;
+    const uint8_t* head_table = nullptr;
+    size_t name_length = 0, os2_length = 0, head_length = 0;
+    for(size_t i = 0; i < num_tables; ++i) {
+        const uint8_t* record = data + offset + 12 + i * 16;
+        size_t table_offset = read_uint32(record + 8);
+        size_t table_length = read_uint32(record + 12);
+        if(table_offset > size || table_length > size - table_offset)
+            continue;
+        switch(read_uint32(record)) {
+        case 0x6E616D65:
+            name_table = data + table_offset;
+            name_length = table_length;
+            break;
+        case 0x4F532F32:
+            os2_table = data + table_offset;
+            os2_length = table_length;
+            break;
+        case 0x68656164:
+            head_table = data + table_offset;
+            head_length = table_length;
+            break;
+        }
+    }
+
+    if(name_table == nullptr)
+        return false;
+    family = font_face_family(name_table, name_length);
+    if(family.empty())
+        return false;
+    if(os2_table && os2_length >= 64) {
+        uint16_t selection = read_uint16(os2_table + 62);
+        italic = selection & 0x01;
+        bold = selection & 0x20;
+    } else if(head_table && head_length >= 46) {
+        uint16_t style = read_uint16(head_table + 44);
+        bold = style & 0x01;
+        italic = style & 0x02;
+    } else {
+        bold = false;
+        italic = false;
+    }
+
+    return true;
+}
+
+struct FontFileEntry {
+    std::string filename;
+    uint64_t size;
+    uint64_t mtime;
+    std::string family;
+    bool bold = false;
+    bool italic = false;
+    bool indexed = false;
+    MemoryMapping* mapping = nullptr;
+};
+
+static bool font_file_extension(const std::string& filename)
+{
+    size_t index = filename.rfind('.');
+    if(index == std::string::npos)
+        return false;
+    std::string extension = filename.substr(index + 1);
+    for(auto& ch : extension)
+        ch = (char)tolower((unsigned char)ch);
+    return extension == "ttf" || extension == "otf" || extension == "ttc" || extension == "otc";
+}
+
+typedef std::set<std::pair<uint64_t, uint64_t>> FontDirectorySet;
+
+static bool font_directory_scan(const std::string& path, bool recursive, std::vector<FontFileEntry>& entries, FontDirectorySet& visited)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((path + "\\*").data(), &data);
+    if(handle == INVALID_HANDLE_VALUE)
+        return false;
+    do {
+        std::string name(data.cFileName);
+        if(name == "." || name == "..")
+            continue;
+        std::string filename = path + "\\" + name;
+        if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if(recursive && !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                font_directory_scan(filename, recursive, entries, visited);
+            }
+        } else if(font_file_extension(name)) {
+            FontFileEntry entry;
+            entry.filename = std::move(filename);
+            entry.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            entry.mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+            entries.push_back(std::move(entry));
+        }
+    } while(FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    struct stat dir_st;
+    if(stat(path.data(), &dir_st) == -1 || !visited.emplace(dir_st.st_dev, dir_st.st_ino).second)
+        return false;
+    DIR* dir = opendir(path.data());
+    if(dir == nullptr)
+        return false;
+    while(struct dirent* ent = readdir(dir)) {
+        std::string name(ent->d_name);
+        if(name == "." || name == "..")
+            continue;
+        std::string filename = path + "/" + name;
+        struct stat st;
+        if(stat(filename.data(), &st) == -1)
+            continue;
+        if(S_ISDIR(st.st_mode)) {
+            if(recursive) {
+                font_directory_scan(filename, recursive, entries, visited);
+            }
+        } else if(S_ISREG(st.st_mode) && font_file_extension(name)) {
+            FontFileEntry entry;
+            entry.filename = std::move(filename);
+            entry.size = st.st_size;
+            entry.mtime = st.st_mtime;
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    closedir(dir);
+#endif
+    return true;
+}
+
+static const char* FontIndex_Signature = "lunasvg-font-index 1";
+
+static void font_index_load(const char* filename, std::vector<FontFileEntry>& entries)
+{
+    FILE* fp = fopen(filename, "rb");
+    if(fp == nullptr)
+        return;
+    std::string content;
+    char buffer[4096];
+    size_t length;
+    while((length = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        content.append(buffer, length);
+    fclose(fp);
+
+    size_t position = content.find('\n');
+    if(position == std::string::npos || content.compare(0, position, FontIndex_Signature) != 0)
+        return;
+    while(++position < content.size()) {
+        size_t end = content.find('\n', position);
+        if(end == std::string::npos)
+            end = content.size();
+        std::string line = content.substr(position, end - position);
+        position = end;
+
+        unsigned long long size, mtime;
+        int bold, italic, offset = 0;
+        if(sscanf(line.data(), "%llu\t%llu\t%d\t%d\t%n", &size, &mtime, &bold, &italic, &offset) != 4 || offset == 0)
+            continue;
+        size_t separator = line.find('\t', offset);
+        if(separator == std::string::npos)
+            continue;
+        std::string family = line.substr(offset, separator - offset);
+        std::string path = line.substr(separator + 1);
+        for(auto& entry : entries) {
+            if(entry.filename == path && entry.size == size && entry.mtime == mtime) {
+                entry.family = family;
+                entry.bold = bold;
+                entry.italic = italic;
+                entry.indexed = true;
+                break;
+            }
+        }
+    }
+}
+
+static bool font_index_save(const char* filename, const std::vector<FontFileEntry>& entries)
+{
+    FILE* fp = fopen(filename, "wb");
+    if(fp == nullptr)
+        return false;
+    fprintf(fp, "%s\n", FontIndex_Signature);
+    for(const auto& entry : entries) {
+        if(entry.family.empty() || entry.filename.find('\n') != std::string::npos)
+            continue;
+        std::string family(entry.family);
+        std::replace(family.begin(), family.end(), '\t', ' ');
+        std::replace(family.begin(), family.end(), '\n', ' ');
+        fprintf(fp, "%llu\t%llu\t%d\t%d\t%s\t%s\n", (unsigned long long)entry.size, (unsigned long long)entry.mtime,
+            entry.bold, entry.italic, family.data(), entry.filename.data());
+    }
+
+    return fclose(fp) == 0;
+}
+
+static PyObject* module_add_font_faces_from_directory(PyObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "path", "recursive", "index", nullptr };
+    PyObject* path_ob;
+    int recursive = 1;
+    PyObject* index_ob = nullptr;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O&|pO&", (char**)kwlist, PyUnicode_FSConverter, &path_ob, &recursive, PyUnicode_FSConverter, &index_ob)) {
+        return nullptr;
+    }
+
+    std::string path(PyBytes_AS_STRING(path_ob));
+    const char* index = index_ob ? PyBytes_AS_STRING(index_ob) : nullptr;
+    std::vector<FontFileEntry> entries;
+    bool success = false;
+    bool index_saved = true;
+    int index_errno = 0;
+    Py_BEGIN_ALLOW_THREADS
+    FontDirectorySet visited;
+    success = font_directory_scan(path, recursive, entries, visited);
+    if(success) {
+        std::sort(entries.begin(), entries.end(), [](const FontFileEntry& a, const FontFileEntry& b) {
+            return a.filename < b.filename;
+        });
+
+        if(index)
+            font_index_load(index, entries);
+        std::atomic<bool> index_stale(false);
+        parallel_for(entries.size(), [&](size_t i) {
+            FontFileEntry& entry = entries[i];
+            entry.mapping = memory_mapping_open_file(entry.filename.data());
+            if(entry.mapping == nullptr) {
+                entry.family.clear();
+                index_stale = true;
+                return;
+            }
+
+            if(entry.indexed)
+                return;
+            index_stale = true;
+            if(!font_face_parse((const uint8_t*)entry.mapping->data, entry.mapping->size, entry.family, entry.bold, entry.italic)) {
+                entry.family.clear();
+            }
+        });
+
+        if(index && index_stale) {
+            index_saved = font_index_save(index, entries);
+            index_errno = errno;
+        }
+
+        for(auto& entry : entries) {
+            if(entry.mapping == nullptr)
+                continue;
+            if(entry.family.empty()) {
+                memory_mapping_free(entry.mapping);
+            } else if(!lunasvg_add_font_face_from_data(entry.family.data(), entry.bold, entry.italic, entry.mapping->data, entry.mapping->size, memory_mapping_free, entry.mapping)) {
+                entry.family.clear();
+            }
+
+            entry.mapping = nullptr;
+        }
+    }
+
+    Py_END_ALLOW_THREADS
+    if(!success) {
+        filename_error(PyBytes_AS_STRING(path_ob));
+        Py_DECREF(path_ob);
+        Py_XDECREF(index_ob);
+        return nullptr;
+    }
+
+    Py_DECREF(path_ob);
+    PyObject* faces_ob = PyList_New(0);
+    if(faces_ob == nullptr) {
+        Py_XDECREF(index_ob);
+        return nullptr;
+    }
+
+    for(const auto& entry : entries) {
+        if(entry.family.empty())
+            continue;
+        PyObject* source_ob = PyUnicode_DecodeFSDefault(entry.filename.data());
+        if(source_ob == nullptr || font_faces_register(entry.family.data(), entry.bold, entry.italic, source_ob) == -1) {
+            Py_XDECREF(source_ob);
+            Py_DECREF(faces_ob);
+            Py_XDECREF(index_ob);
+            return nullptr;
+        }
+
+        PyObject* face_ob = PyList_GET_ITEM(font_faces_list, PyList_GET_SIZE(font_faces_list) - 1);
+        Py_DECREF(source_ob);
+        if(PyList_Append(faces_ob, face_ob) == -1) {
+            Py_DECREF(faces_ob);
+            Py_XDECREF(index_ob);
+            return nullptr;
+        }
+    }
+
+    if(!index_saved && PyErr_WarnFormat(PyExc_RuntimeWarning, 1, "Failed to save font index '%s': %s", index, strerror(index_errno)) == -1) {
+        Py_DECREF(faces_ob);
+        Py_XDECREF(index_ob);
+        return nullptr;
+    }
+
+    Py_XDECREF(index_ob);
+    return faces_ob;
+}
+
+static PyObject* module_font_faces(PyObject* self, PyObject* args)
+{
+    return PyList_GetSlice(font_faces_list, 0, PyList_GET_SIZE(font_faces_list));
+}
+
 static PyMethodDef module_methods[] = {
     {"add_font_face_from_file", (PyCFunction)module_add_font_face_from_file, METH_VARARGS},
     {"add_font_face_from_data", (PyCFunction)module_add_font_face_from_data, METH_VARARGS},
+    {"add_font_faces_from_directory", (PyCFunction)module_add_font_faces_from_directory, METH_VARARGS | METH_KEYWORDS},
+    {"font_faces", (PyCFunction)module_font_faces, METH_NOARGS},
     {nullptr}
 };
 
@@ -954,6 +3601,7 @@ PyMODINIT_FUNC PyInit__lunasvg(void)
     Bitmap_Type.tp_as_buffer = &Bitmap_as_buffer;
     Bitmap_Type.tp_flags = Py_TPFLAGS_DEFAULT;
     Bitmap_Type.tp_methods = Bitmap_methods;
+    Bitmap_Type.tp_getset = Bitmap_getset;
     Bitmap_Type.tp_new = (newfunc)Bitmap__new__;
     if(PyType_Ready(&Bitmap_Type) < 0) {
         return nullptr;
@@ -979,6 +3627,11 @@ PyMODINIT_FUNC PyInit__lunasvg(void)
         return nullptr;
     }
 
+    font_faces_list = PyList_New(0);
+    if(font_faces_list == nullptr) {
+        return nullptr;
+    }
+
     PyObject* module = PyModule_Create(&module_definition);
     if(module == nullptr) {
         return nullptr;